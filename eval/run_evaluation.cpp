@@ -1,7 +1,9 @@
 #include <opencv2/opencv.hpp>
 #include "algorithm/face_detection/face_detection.h"
 #include "../src/algorithm/heart_rate_algorithm.h"
+#include "../src/frame_buffer_pool.h"
 
+#include <chrono>
 #include <thread>
 #include <mutex>
 #include <future>
@@ -13,18 +15,28 @@
 
 std::mutex outputMutex;
 
-enum class PreFilteringAlgorithm { NONE, BUTTERWORTH_BANDPASS, DETREND, ZERO_MEAN, LAST };
+enum class PreFilteringAlgorithm {
+	NONE,
+	BUTTERWORTH_BANDPASS,
+	DETREND,
+	ZERO_MEAN,
+	BUTTERWORTH_BANDPASS_ZERO_PHASE,
+	LAST
+};
 
 enum class PPGAlgorithm {
 	GREEN,
 	PCA,
 	CHROM,
+	POS,
 };
 
 enum class PostFilteringAlgorithm { NONE, BUTTERWORTH_BANDPASS, LAST };
 
 enum class Smoothing { OFF, ON };
 
+enum class SpectralEstimator { WELCH, GOERTZEL };
+
 std::string toString(FaceDetectionAlgorithm algo)
 {
 	switch (algo) {
@@ -48,6 +60,8 @@ std::string toString(PreFilteringAlgorithm algo)
 		return "DETREND";
 	case PreFilteringAlgorithm::ZERO_MEAN:
 		return "ZERO_MEAN";
+	case PreFilteringAlgorithm::BUTTERWORTH_BANDPASS_ZERO_PHASE:
+		return "BUTTERWORTH_BANDPASS_ZERO_PHASE";
 	default:
 		return "UNKNOWN";
 	}
@@ -62,6 +76,20 @@ std::string toString(PPGAlgorithm algo)
 		return "PCA";
 	case PPGAlgorithm::CHROM:
 		return "CHROM";
+	case PPGAlgorithm::POS:
+		return "POS";
+	default:
+		return "UNKNOWN";
+	}
+}
+
+std::string toString(SpectralEstimator estimator)
+{
+	switch (estimator) {
+	case SpectralEstimator::WELCH:
+		return "WELCH";
+	case SpectralEstimator::GOERTZEL:
+		return "GOERTZEL";
 	default:
 		return "UNKNOWN";
 	}
@@ -88,9 +116,9 @@ struct VideoData {
 	double chromMAE;
 };
 
+// The ground truth holds one heart rate per second of video, from its start
 std::vector<VideoData> readCSV(const std::string &csvFilePath)
 {
-	static int calibrationTime = 5;
 	std::vector<VideoData> videoDataList;
 	std::ifstream file(csvFilePath);
 	std::string line;
@@ -106,14 +134,10 @@ std::vector<VideoData> readCSV(const std::string &csvFilePath)
 
 		// Read the ground truth heart rates
 		std::getline(ss, token, ','); // Skip the initial '['
-		int count = 0;
 		while (std::getline(ss, token, ',')) {
 			if (token == "]")
 				break;
-			if (count >= calibrationTime) { // Skip the first few heart rates for calibration
-				groundTruthHeartRates.push_back(std::stod(token));
-			}
-			count++;
+			groundTruthHeartRates.push_back(std::stod(token));
 		}
 
 		// Read the PCA RMSE and MAE
@@ -135,50 +159,62 @@ std::vector<VideoData> readCSV(const std::string &csvFilePath)
 	return videoDataList;
 }
 
-// Function to extract BGRA data from a video frame
-std::shared_ptr<input_BGRA_data> extractBGRAData(const cv::Mat &frame)
+// Function to extract BGRA data from a video frame into a pooled buffer
+std::shared_ptr<input_BGRA_data> extractBGRAData(FrameBufferPool &pool, const cv::Mat &frame)
 {
-	std::shared_ptr<input_BGRA_data> bgraData(static_cast<input_BGRA_data *>(bzalloc(sizeof(input_BGRA_data))),
-						  [](input_BGRA_data *p) {
-							  if (p)
-								  bfree(p);
-						  });
-	bgraData->width = frame.cols;
-	bgraData->height = frame.rows;
-	bgraData->linesize = static_cast<uint32_t>(frame.step);
-	bgraData->data = new uint8_t[frame.total() * frame.elemSize()];
+	std::shared_ptr<input_BGRA_data> bgraData =
+		pool.acquire(frame.cols, frame.rows, static_cast<uint32_t>(frame.step));
+	if (!bgraData) {
+		return nullptr;
+	}
 	std::memcpy(bgraData->data, frame.data, frame.total() * frame.elemSize());
 	return bgraData;
 }
 
-double calculateMAE(const std::vector<double> &actual, const std::vector<double> &predicted)
+// Each prediction is compared with the ground truth for the second of video its frame falls in, so the seconds spent
+// calibrating are skipped however long the algorithm takes. Returns -1 if no prediction falls within the ground truth
+double calculateMAE(const std::vector<double> &actual, const std::vector<double> &predicted,
+		    const std::vector<double> &times)
 {
-	// Use the smaller length of the two vectors
-	size_t length = std::min(actual.size(), predicted.size());
-
 	double mae = 0.0;
-	for (size_t i = 0; i < length; ++i) {
-		mae += std::fabs(actual[i] - predicted[i]); // Absolute error
+	size_t counted = 0;
+	for (size_t i = 0; i < predicted.size(); ++i) {
+		size_t second = static_cast<size_t>(times[i]);
+		if (second >= actual.size()) {
+			continue;
+		}
+		mae += std::fabs(actual[second] - predicted[i]); // Absolute error
+		counted++;
 	}
-	return mae / length;
+	return counted > 0 ? mae / counted : -1.0;
 }
 
-double calculateRMSE(const std::vector<double> &actual, const std::vector<double> &predicted)
+double calculateRMSE(const std::vector<double> &actual, const std::vector<double> &predicted,
+		     const std::vector<double> &times)
 {
-	// Use the smaller length of the two vectors
-	size_t length = std::min(actual.size(), predicted.size());
-
 	double rmse = 0.0;
-	for (size_t i = 0; i < length; ++i) {
-		rmse += std::pow(actual[i] - predicted[i], 2); // Squared error
+	size_t counted = 0;
+	for (size_t i = 0; i < predicted.size(); ++i) {
+		size_t second = static_cast<size_t>(times[i]);
+		if (second >= actual.size()) {
+			continue;
+		}
+		rmse += std::pow(actual[second] - predicted[i], 2); // Squared error
+		counted++;
 	}
-	return std::sqrt(rmse / length);
+	return counted > 0 ? std::sqrt(rmse / counted) : -1.0;
 }
 
+// Returns the heart rates predicted once calibrated, the time in the video of each in times, and the mean time each
+// heart rate update took in updateTimeUs. Provisional estimates are left out, they only stand in while calibrating
 std::vector<double> calculateHeartRateForVideo(const VideoData &videoData, FaceDetectionAlgorithm faceDetect,
 					       PreFilteringAlgorithm preFilter, PPGAlgorithm ppg,
-					       PostFilteringAlgorithm postFilter)
+					       PostFilteringAlgorithm postFilter, SpectralEstimator estimator,
+					       std::vector<double> &times, double &updateTimeUs)
 {
+	times.clear();
+	updateTimeUs = 0.0;
+
 	cv::VideoCapture cap(videoData.videoPath);
 	if (!cap.isOpened()) {
 		std::cerr << "Error: Could not open video file " << videoData.videoPath << std::endl;
@@ -186,12 +222,15 @@ std::vector<double> calculateHeartRateForVideo(const VideoData &videoData, FaceD
 	}
 
 	MovingAvg movingAvg;
+	std::shared_ptr<FrameBufferPool> framePool = FrameBufferPool::create(2);
 	std::unique_ptr<FaceDetection> faceDetection = FaceDetection::create(faceDetect);
 	cv::Mat frame;
 
 	int fps = static_cast<int>(cap.get(cv::CAP_PROP_FPS));
 
 	std::vector<double> predicted;
+	std::chrono::nanoseconds updateTime(0);
+	int numUpdates = 0;
 
 	while (cap.read(frame)) {
 		std::vector<struct vec4> faceCoordinates;
@@ -201,24 +240,35 @@ std::vector<double> calculateHeartRateForVideo(const VideoData &videoData, FaceD
 		cv::cvtColor(frame, bgraFrame, cv::COLOR_BGR2BGRA);
 
 		// Extract BGRA data
-		std::shared_ptr<input_BGRA_data> bgraData = extractBGRAData(bgraFrame);
+		std::shared_ptr<input_BGRA_data> bgraData = extractBGRAData(*framePool, bgraFrame);
+		if (!bgraData) {
+			continue; // Every buffer is still in use, skip the frame
+		}
 
 		// Perform face detection
 		std::vector<double_t> avg = faceDetection->detectFace(bgraData, faceCoordinates, false, true, 60, true);
 
+		// Decoded frame time, so frames the decoder skips or duplicates are resampled away
+		double timestamp = cap.get(cv::CAP_PROP_POS_MSEC) / 1000.0;
+
 		// Calculate heart rate using your algorithm
+		auto start = std::chrono::steady_clock::now();
 		double heartRate = movingAvg.calculateHeartRate(avg, static_cast<int>(preFilter), static_cast<int>(ppg),
-								static_cast<int>(postFilter), fps, 1, false);
+								static_cast<int>(postFilter), true, fps, 1, timestamp,
+								static_cast<int>(estimator));
+		updateTime += std::chrono::steady_clock::now() - start;
+		numUpdates++;
 
-		if (heartRate != 0 && heartRate != -1) {
+		if (heartRate != 0 && heartRate != -1 && !movingAvg.isProvisional()) {
 			predicted.push_back(heartRate);
+			times.push_back(timestamp);
 		}
-
-		// Clean up
-		delete[] bgraData->data;
 	}
 
 	cap.release();
+	if (numUpdates > 0) {
+		updateTimeUs = std::chrono::duration<double, std::micro>(updateTime).count() / numUpdates;
+	}
 	return predicted;
 }
 
@@ -234,11 +284,15 @@ std::string centerAlign(const std::string &text, int width)
 }
 
 void processVideo(const VideoData &videoData, FaceDetectionAlgorithm faceDetect, PreFilteringAlgorithm preFilter,
-		  PPGAlgorithm ppg, PostFilteringAlgorithm postFilter, std::ofstream &outFile)
+		  PPGAlgorithm ppg, PostFilteringAlgorithm postFilter, SpectralEstimator estimator,
+		  std::ofstream &outFile)
 {
-	std::vector<double> predicted = calculateHeartRateForVideo(videoData, faceDetect, preFilter, ppg, postFilter);
-	double ourAlgorithmRMSE = calculateRMSE(videoData.groundTruthHeartRate, predicted);
-	double ourAlgorithmMAE = calculateMAE(videoData.groundTruthHeartRate, predicted);
+	double updateTimeUs;
+	std::vector<double> times;
+	std::vector<double> predicted = calculateHeartRateForVideo(videoData, faceDetect, preFilter, ppg, postFilter,
+								   estimator, times, updateTimeUs);
+	double ourAlgorithmRMSE = calculateRMSE(videoData.groundTruthHeartRate, predicted, times);
+	double ourAlgorithmMAE = calculateMAE(videoData.groundTruthHeartRate, predicted, times);
 
 	// Extract the subject name from the video path
 	std::string subjectName = videoData.videoPath.substr(videoData.videoPath.find_last_of("/") + 1);
@@ -251,6 +305,7 @@ void processVideo(const VideoData &videoData, FaceDetectionAlgorithm faceDetect,
 	std::string ourAlgorithmRMSEStr = std::to_string(ourAlgorithmRMSE);
 	std::string otherAlgorithmRMSEStr = (ppg == PPGAlgorithm::CHROM) ? std::to_string(videoData.chromRMSE)
 									 : std::to_string(videoData.pcaRMSE);
+	std::string updateTimeStr = std::to_string(updateTimeUs);
 
 	// Lock the mutex before writing to the console and file
 	std::lock_guard<std::mutex> lock(outputMutex);
@@ -260,31 +315,37 @@ void processVideo(const VideoData &videoData, FaceDetectionAlgorithm faceDetect,
 		  << std::left << centerAlign(ourAlgorithmMAEStr, 17) << " | " << std::setw(19) << std::left
 		  << centerAlign(otherAlgorithmMAEStr, 19) << " | " << std::setw(18) << std::left
 		  << centerAlign(ourAlgorithmRMSEStr, 18) << " | " << std::setw(20) << std::left
-		  << centerAlign(otherAlgorithmRMSEStr, 20) << " |\n";
+		  << centerAlign(otherAlgorithmRMSEStr, 20) << " | " << std::setw(16) << std::left
+		  << centerAlign(updateTimeStr, 16) << " |\n";
 
 	// Write the results to the CSV file
 	outFile << subjectName << "," << ourAlgorithmMAEStr << "," << otherAlgorithmMAEStr << "," << ourAlgorithmRMSEStr
-		<< "," << otherAlgorithmRMSEStr << "\n";
+		<< "," << otherAlgorithmRMSEStr << "," << updateTimeStr << "\n";
 }
 
 void evaluateHeartRate(const std::string &csvFilePath, FaceDetectionAlgorithm faceDetect,
-		       PreFilteringAlgorithm preFilter, PPGAlgorithm ppg, PostFilteringAlgorithm postFilter)
+		       PreFilteringAlgorithm preFilter, PPGAlgorithm ppg, PostFilteringAlgorithm postFilter,
+		       SpectralEstimator estimator)
 {
 	std::vector<VideoData> videoDataList = readCSV(csvFilePath);
 
 	// Construct the results filename based on the parameters
 	std::string resultsFilename = "../../../../../eval/results/" + toString(faceDetect) + "_" +
-				      toString(preFilter) + "_" + toString(ppg) + "_" + toString(postFilter) + ".csv";
+				      toString(preFilter) + "_" + toString(ppg) + "_" + toString(postFilter) + "_" +
+				      toString(estimator) + ".csv";
 
 	// Print the table header
 	std::cout
-		<< "| Test Subject | Our Algorithm MAE | Other Algorithm MAE | Our Algorithm RMSE | Other Algorithm RMSE |\n";
+		<< "| Test Subject | Our Algorithm MAE | Other Algorithm MAE | Our Algorithm RMSE "
+		<< "| Other Algorithm RMSE | Update Time (us) |\n";
 	std::cout
-		<< "|--------------|-------------------|---------------------|--------------------|----------------------|\n";
+		<< "|--------------|-------------------|---------------------|--------------------"
+		<< "|----------------------|------------------|\n";
 
 	// Open the CSV file for writing
 	std::ofstream outFile(resultsFilename);
-	outFile << "Test Subject,Our Algorithm MAE,Other Algorithm MAE,Our Algorithm RMSE,Other Algorithm RMSE\n";
+	outFile << "Test Subject,Our Algorithm MAE,Other Algorithm MAE,Our Algorithm RMSE,Other Algorithm RMSE,"
+		<< "Update Time (us)\n";
 
 	// Vector to hold futures for each thread
 	std::vector<std::future<void>> futures;
@@ -292,7 +353,7 @@ void evaluateHeartRate(const std::string &csvFilePath, FaceDetectionAlgorithm fa
 	for (const auto &videoData : videoDataList) {
 		// Create a future for each video evaluation
 		futures.push_back(std::async(std::launch::async, processVideo, std::ref(videoData), faceDetect,
-					     preFilter, ppg, postFilter, std::ref(outFile)));
+					     preFilter, ppg, postFilter, estimator, std::ref(outFile)));
 	}
 
 	// Wait for all threads to complete
@@ -307,17 +368,19 @@ void evaluateHeartRate(const std::string &csvFilePath, FaceDetectionAlgorithm fa
 int main()
 {
 	std::string csvFilePath = "../../../../../eval/ground_truth.csv";
-	std::vector<PreFilteringAlgorithm> preFilteringAlgorithms = {PreFilteringAlgorithm::NONE,
-								     PreFilteringAlgorithm::BUTTERWORTH_BANDPASS,
-								     PreFilteringAlgorithm::DETREND,
-								     PreFilteringAlgorithm::ZERO_MEAN};
+	std::vector<PreFilteringAlgorithm> preFilteringAlgorithms = {
+		PreFilteringAlgorithm::NONE, PreFilteringAlgorithm::BUTTERWORTH_BANDPASS, PreFilteringAlgorithm::DETREND,
+		PreFilteringAlgorithm::ZERO_MEAN, PreFilteringAlgorithm::BUTTERWORTH_BANDPASS_ZERO_PHASE};
 	std::vector<PostFilteringAlgorithm> postFilteringAlgorithms = {PostFilteringAlgorithm::NONE,
 								       PostFilteringAlgorithm::BUTTERWORTH_BANDPASS};
+	std::vector<SpectralEstimator> spectralEstimators = {SpectralEstimator::WELCH, SpectralEstimator::GOERTZEL};
 
 	for (PreFilteringAlgorithm preFilteringAlgorithm : preFilteringAlgorithms) {
 		for (PostFilteringAlgorithm postFilteringAlgorithm : postFilteringAlgorithms) {
-			evaluateHeartRate(csvFilePath, FaceDetectionAlgorithm::DLIB, preFilteringAlgorithm,
-					  PPGAlgorithm::CHROM, postFilteringAlgorithm);
+			for (SpectralEstimator spectralEstimator : spectralEstimators) {
+				evaluateHeartRate(csvFilePath, FaceDetectionAlgorithm::DLIB, preFilteringAlgorithm,
+						  PPGAlgorithm::CHROM, postFilteringAlgorithm, spectralEstimator);
+			}
 		}
 	}
 
@@ -0,0 +1,216 @@
+#include "beat_detector.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Intervals kept for the statistics, about half a minute at resting heart rates
+static const int HRV_INTERVALS = 32;
+// Intervals needed before the statistics are reported
+static const int HRV_MIN_INTERVALS = 8;
+// Shortest and longest plausible intervals in seconds, 200 and 40 BPM
+static const double MIN_INTERVAL = 0.3;
+static const double MAX_INTERVAL = 1.5;
+// Intervals further than this fraction from the expected one are taken as missed or extra beats
+static const double MAX_INTERVAL_CHANGE = 0.3;
+// Peaks closer than this fraction of the expected interval belong to the same beat, which is placed at the highest
+static const double SAME_BEAT_FRACTION = 0.6;
+// Time constant of the running level and deviation, in seconds
+static const double LEVEL_SECONDS = 2.0;
+// A lobe starts this many deviations above the level and ends as far below it
+static const double LOBE_HYSTERESIS = 0.25;
+
+void BeatDetector::reset(int Fps)
+{
+	fps = Fps;
+	index = 0;
+	primed = false;
+	level = 0.0;
+	spread = 0.0;
+	armed = false;
+	inLobe = false;
+	lastBeat = -1.0;
+	candidate = -1.0;
+	expected = 0.0;
+
+	intervals.assign(HRV_INTERVALS, 0.0);
+	follows.assign(HRV_INTERVALS, false);
+	gap = true;
+	head = 0;
+	count = 0;
+	resyncSums();
+}
+
+bool BeatDetector::push(double sample)
+{
+	if (fps <= 0) {
+		return false;
+	}
+	uint64_t current = index++;
+	if (!primed) {
+		level = sample;
+		spread = 0.0;
+		previous = sample;
+		primed = true;
+		return false;
+	}
+
+	bool found = false;
+	if (inLobe) {
+		if (current == peakIndex + 1) {
+			peakAfter = sample;
+		}
+		if (sample > peak) {
+			peakBefore = previous;
+			peak = sample;
+			peakAfter = sample;
+			peakIndex = current;
+		}
+		if (sample < level - LOBE_HYSTERESIS * spread) {
+			// Vertex of the parabola through the highest sample and its neighbours
+			double curvature = peakBefore - 2.0 * peak + peakAfter;
+			double offset = 0.0;
+			if (curvature < 0.0) {
+				offset = std::clamp(0.5 * (peakBefore - peakAfter) / curvature, -0.5, 0.5);
+			}
+			found = beat((static_cast<double>(peakIndex) + offset) / fps, peak - level);
+			inLobe = false;
+			armed = true;
+		}
+	} else if (sample < level - LOBE_HYSTERESIS * spread) {
+		armed = true;
+	} else if (armed && spread > 0.0 && sample > level + LOBE_HYSTERESIS * spread) {
+		armed = false;
+		inLobe = true;
+		peakBefore = previous;
+		peak = sample;
+		peakAfter = sample;
+		peakIndex = current;
+	}
+
+	double alpha = 1.0 / (LEVEL_SECONDS * fps);
+	level += alpha * (sample - level);
+	spread += alpha * (std::abs(sample - level) - spread);
+	previous = sample;
+	return found;
+}
+
+void BeatDetector::skip(uint64_t numSamples)
+{
+	if (numSamples == 0) {
+		return;
+	}
+	index += numSamples;
+	armed = false;
+	inLobe = false;
+	lastBeat = -1.0;
+	candidate = -1.0;
+	gap = true;
+}
+
+void BeatDetector::setExpectedInterval(double seconds)
+{
+	expected = seconds >= MIN_INTERVAL && seconds <= MAX_INTERVAL ? seconds : 0.0;
+}
+
+bool BeatDetector::beat(double time, double height)
+{
+	// Later peaks of the same beat only move it to the highest
+	double sameBeat = expected > 0.0 ? SAME_BEAT_FRACTION * expected : MIN_INTERVAL;
+	if (candidate >= 0.0 && time - candidate < sameBeat) {
+		if (height > candidateHeight) {
+			candidate = time;
+			candidateHeight = height;
+		}
+		return false;
+	}
+
+	// A peak clear of the candidate confirms it as a beat
+	double confirmed = candidate;
+	candidate = time;
+	candidateHeight = height;
+	if (confirmed < 0.0) {
+		return false;
+	}
+	double seconds = lastBeat < 0.0 ? 0.0 : confirmed - lastBeat;
+	lastBeat = confirmed;
+
+	bool plausible = expected > 0.0 ? std::abs(seconds - expected) <= MAX_INTERVAL_CHANGE * expected
+					: seconds >= MIN_INTERVAL && seconds <= MAX_INTERVAL;
+	if (plausible) {
+		addInterval(seconds);
+	} else {
+		gap = true;
+	}
+	return true;
+}
+
+void BeatDetector::addInterval(double seconds)
+{
+	int capacity = static_cast<int>(intervals.size());
+	if (count == capacity) {
+		double oldest = interval(0);
+		sum -= oldest;
+		sumSquares -= oldest * oldest;
+		if (followsPrevious(1)) {
+			double difference = interval(1) - oldest;
+			sumSuccessive -= difference * difference;
+			numSuccessive--;
+			numOver50 -= std::abs(difference) > 0.05;
+		}
+		head = (head + 1) % capacity;
+		follows[head] = false;
+		count--;
+	}
+	bool afterPrevious = count > 0 && !gap;
+	if (afterPrevious) {
+		double difference = seconds - interval(count - 1);
+		sumSuccessive += difference * difference;
+		numSuccessive++;
+		numOver50 += std::abs(difference) > 0.05;
+	}
+	intervals[(head + count) % capacity] = seconds;
+	follows[(head + count) % capacity] = afterPrevious;
+	count++;
+	gap = false;
+	sum += seconds;
+	sumSquares += seconds * seconds;
+
+	// Rounding left by removing intervals is cleared regularly
+	if (++pushesSinceResync >= capacity) {
+		resyncSums();
+	}
+}
+
+void BeatDetector::resyncSums()
+{
+	sum = sumSquares = sumSuccessive = 0.0;
+	numSuccessive = numOver50 = 0;
+	for (int i = 0; i < count; ++i) {
+		double value = interval(i);
+		sum += value;
+		sumSquares += value * value;
+		if (i > 0 && followsPrevious(i)) {
+			double difference = value - interval(i - 1);
+			sumSuccessive += difference * difference;
+			numSuccessive++;
+			numOver50 += std::abs(difference) > 0.05;
+		}
+	}
+	pushesSinceResync = 0;
+}
+
+HrvStats BeatDetector::stats() const
+{
+	HrvStats hrv;
+	if (count > 0) {
+		hrv.ibi = interval(count - 1) * 1000.0;
+	}
+	if (count >= HRV_MIN_INTERVALS) {
+		hrv.sdnn = std::sqrt(std::max(sumSquares - sum * sum / count, 0.0) / (count - 1)) * 1000.0;
+	}
+	if (count >= HRV_MIN_INTERVALS && numSuccessive > 0) {
+		hrv.rmssd = std::sqrt(std::max(sumSuccessive, 0.0) / numSuccessive) * 1000.0;
+		hrv.pnn50 = static_cast<double>(numOver50) / numSuccessive;
+	}
+	return hrv;
+}
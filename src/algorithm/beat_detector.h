@@ -0,0 +1,78 @@
+#ifndef BEAT_DETECTOR_H
+#define BEAT_DETECTOR_H
+
+#include <cstdint>
+#include <vector>
+
+// Heart rate variability over the latest inter-beat intervals, -1 until there are enough of them
+struct HrvStats {
+	double ibi = -1.0;   // Latest inter-beat interval, in milliseconds
+	double sdnn = -1.0;  // Standard deviation of the intervals, in milliseconds
+	double rmssd = -1.0; // Root mean square of successive differences, in milliseconds
+	double pnn50 = -1.0; // Fraction of successive differences over 50 ms
+};
+
+// Finds beats in a pulse one sample at a time, as the peaks of lobes that rise clearly above the pulse's running
+// level, and keeps running sums over the latest intervals so every sample costs the same whatever the window.
+class BeatDetector {
+public:
+	// Pulse sampled at fps, starting again with no beats
+	void reset(int fps);
+	// Takes the next pulse sample, true if it confirmed a beat
+	bool push(double sample);
+	// Skips count samples that are not available, no interval or successive difference is measured across them
+	void skip(uint64_t count);
+	// Interval the heart rate estimate expects, which intervals far from it are discarded against. 0 if unknown
+	void setExpectedInterval(double seconds);
+
+	HrvStats stats() const;
+
+private:
+	int fps = 0;
+	uint64_t index = 0; // Of the next sample
+
+	// Running level and mean absolute deviation of the pulse
+	bool primed = false;
+	double level = 0.0;
+	double spread = 0.0;
+
+	// Lobe being tracked, with the samples either side of its highest so the peak can be placed between them. A lobe
+	// is only entered once the pulse has been below the level, so it is never entered after its peak
+	bool armed = false;
+	bool inLobe = false;
+	double previous = 0.0;
+	double peakBefore = 0.0;
+	double peak = 0.0;
+	double peakAfter = 0.0;
+	uint64_t peakIndex = 0;
+
+	// Times in seconds of the last confirmed beat, and of the latest peak, which is a beat once no higher peak
+	// of the same beat follows
+	double lastBeat = -1.0;
+	double candidate = -1.0;
+	double candidateHeight = 0.0;
+	double expected = 0.0;
+
+	// Ring of the latest intervals in seconds, and whether each directly follows the one before it, with the running
+	// sums the statistics come from. An interval after skipped samples or a discarded interval starts a new run, so
+	// no successive difference is taken across the gap
+	std::vector<double> intervals;
+	std::vector<char> follows;
+	bool gap = true;
+	int head = 0;
+	int count = 0;
+	int pushesSinceResync = 0;
+	double sum = 0.0;
+	double sumSquares = 0.0;
+	double sumSuccessive = 0.0; // Squared differences between neighbouring intervals
+	int numSuccessive = 0;
+	int numOver50 = 0; // Neighbouring intervals more than 50 ms apart
+
+	bool beat(double time, double height);
+	void addInterval(double seconds);
+	void resyncSums();
+	double interval(int i) const { return intervals[(head + i) % intervals.size()]; }
+	bool followsPrevious(int i) const { return follows[(head + i) % follows.size()]; }
+};
+
+#endif
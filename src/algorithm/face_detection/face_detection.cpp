@@ -10,4 +10,111 @@ std::unique_ptr<FaceDetection> FaceDetection::create(FaceDetectionAlgorithm algo
 		return std::make_unique<DlibFaceDetection>();
 	}
 	return nullptr;
-}
\ No newline at end of file
+}
+
+bool FaceDetection::getFaceBox(struct vec4 &box) const
+{
+	if (faceFound) {
+		box = faceBox;
+	}
+	return faceFound;
+}
+
+void FaceDetection::getMaskPolygons(std::vector<std::vector<struct vec2>> &include,
+				    std::vector<std::vector<struct vec2>> &exclude) const
+{
+	if (faceFound) {
+		include = includePolygons;
+		exclude = excludePolygons;
+	} else {
+		include.clear();
+		exclude.clear();
+	}
+}
+
+std::vector<double_t> FaceDetection::maskedMean(const std::shared_ptr<struct input_BGRA_data> &frame,
+						const std::shared_ptr<struct input_BGRA_data> &faceCrop,
+						const std::vector<std::vector<cv::Point>> &include,
+						const std::vector<std::vector<cv::Point>> &exclude)
+{
+	float minX = std::numeric_limits<float>::max();
+	float maxX = std::numeric_limits<float>::lowest();
+	float minY = std::numeric_limits<float>::max();
+	float maxY = std::numeric_limits<float>::lowest();
+
+	for (const auto &polygon : include) {
+		for (const auto &point : polygon) {
+			minX = std::min(minX, static_cast<float>(point.x));
+			maxX = std::max(maxX, static_cast<float>(point.x));
+			minY = std::min(minY, static_cast<float>(point.y));
+			maxY = std::max(maxY, static_cast<float>(point.y));
+		}
+	}
+
+	if (include.empty() || minX > maxX) {
+		faceFound = false;
+		includePolygons.clear();
+		excludePolygons.clear();
+		return std::vector<double_t>(3, 0.0);
+	}
+
+	vec4_set(&faceBox, minX / frame->width, maxX / frame->width, minY / frame->height, maxY / frame->height);
+	faceFound = true;
+
+	auto normalise = [&](const std::vector<std::vector<cv::Point>> &polygons,
+			     std::vector<std::vector<struct vec2>> &normalised) {
+		normalised.resize(polygons.size());
+		for (size_t i = 0; i < polygons.size(); i++) {
+			normalised[i].resize(polygons[i].size());
+			for (size_t j = 0; j < polygons[i].size(); j++) {
+				vec2_set(&normalised[i][j], static_cast<float>(polygons[i][j].x) / frame->width,
+					 static_cast<float>(polygons[i][j].y) / frame->height);
+			}
+		}
+	};
+	normalise(include, includePolygons);
+	normalise(exclude, excludePolygons);
+
+	if (!maskedMeanEnabled) {
+		return std::vector<double_t>(3, 0.0);
+	}
+
+	// Use the crop only if it contains the whole mask, otherwise fall back to the (possibly downscaled) frame
+	const struct vec4 &region = faceCrop ? faceCrop->region : faceBox;
+	bool useCrop = faceCrop && faceCrop->data && region.x <= faceBox.x && region.y >= faceBox.y &&
+		       region.z <= faceBox.z && region.w >= faceBox.w && region.y > region.x && region.w > region.z;
+
+	const std::shared_ptr<struct input_BGRA_data> &source = useCrop ? faceCrop : frame;
+	cv::Mat sourceMat(source->height, source->width, CV_8UC4, source->data, source->linesize);
+
+	// Map frame pixel coordinates into the coordinate space of the image the mean is taken from
+	double scaleX = 1.0, scaleY = 1.0, offsetX = 0.0, offsetY = 0.0;
+	if (useCrop) {
+		scaleX = source->width / ((region.y - region.x) * frame->width);
+		scaleY = source->height / ((region.w - region.z) * frame->height);
+		offsetX = region.x * frame->width;
+		offsetY = region.z * frame->height;
+	}
+
+	auto toSource = [&](const std::vector<cv::Point> &polygon) {
+		std::vector<cv::Point> mapped;
+		mapped.reserve(polygon.size());
+		for (const auto &point : polygon) {
+			mapped.emplace_back(static_cast<int>(std::lround((point.x - offsetX) * scaleX)),
+					    static_cast<int>(std::lround((point.y - offsetY) * scaleY)));
+		}
+		return mapped;
+	};
+
+	cv::Mat maskMat = cv::Mat::zeros(sourceMat.size(), CV_8UC1);
+	for (const auto &polygon : include) {
+		cv::fillConvexPoly(maskMat, toSource(polygon), cv::Scalar(255));
+	}
+	for (const auto &polygon : exclude) {
+		cv::fillConvexPoly(maskMat, toSource(polygon), cv::Scalar(0));
+	}
+
+	// The frame is BGRA, the estimator takes R, G, B
+	cv::Scalar meanBGR = cv::mean(sourceMat, maskMat);
+	return {meanBGR[2], meanBGR[1], meanBGR[0]};
+}
@@ -2,6 +2,8 @@
 #define FACE_DETECTION_H
 
 #include <vector>
+#include <graphics/vec2.h>
+#include <graphics/vec4.h>
 #include <dlib/image_processing.h>
 #include <dlib/image_processing/frontal_face_detector.h>
 #include <dlib/image_processing/render_face_detections.h>
@@ -13,12 +15,35 @@ enum class FaceDetectionAlgorithm { HAAR_CASCADE, DLIB };
 class FaceDetection {
 public:
 	virtual ~FaceDetection() = default;
+	// Mean R, G, B of the skin in the frame, or zeros if no face is found
 	virtual std::vector<double_t> detectFace(std::shared_ptr<struct input_BGRA_data> bgraData,
 						 std::vector<struct vec4> &faceCoordinates, bool enableDebugBoxes,
-						 bool enableTracker, int frameUpdateInterval,
-						 bool evaluation = false) = 0;
+						 bool enableTracker, int frameUpdateInterval, bool evaluation = false,
+						 std::shared_ptr<struct input_BGRA_data> faceCrop = nullptr) = 0;
+
+	// Normalised (minX, maxX, minY, maxY) bounds of the skin mask used for the last frame
+	bool getFaceBox(struct vec4 &box) const;
+	// Normalised skin mask polygons used for the last frame, so the mean can also be taken on the GPU
+	void getMaskPolygons(std::vector<std::vector<struct vec2>> &include,
+			     std::vector<std::vector<struct vec2>> &exclude) const;
+	// Skip the CPU mean when it is taken on the GPU instead, the mask is still tracked
+	void setMaskedMeanEnabled(bool enabled) { maskedMeanEnabled = enabled; }
 
 	static std::unique_ptr<FaceDetection> create(FaceDetectionAlgorithm algorithm);
+
+protected:
+	// Mean colour inside the include polygons, minus the exclude polygons, given in frame pixel coordinates.
+	// If a full-resolution face crop covering the mask is available the mean is taken from the crop instead.
+	std::vector<double_t> maskedMean(const std::shared_ptr<struct input_BGRA_data> &frame,
+					 const std::shared_ptr<struct input_BGRA_data> &faceCrop,
+					 const std::vector<std::vector<cv::Point>> &include,
+					 const std::vector<std::vector<cv::Point>> &exclude);
+
+	struct vec4 faceBox;
+	bool faceFound = false;
+	std::vector<std::vector<struct vec2>> includePolygons;
+	std::vector<std::vector<struct vec2>> excludePolygons;
+	bool maskedMeanEnabled = true;
 };
 
-#endif // FACE_DETECTION_H
\ No newline at end of file
+#endif // FACE_DETECTION_H
@@ -58,7 +58,8 @@ void DlibFaceDetection::loadFiles(bool evaluation)
 // Function to detect face on the first frame and track in subsequent frames
 std::vector<double_t> DlibFaceDetection::detectFace(std::shared_ptr<struct input_BGRA_data> frame,
 						    std::vector<struct vec4> &faceCoordinates, bool enableDebugBoxes,
-						    bool enableTracker, int frameUpdateInterval, bool evaluation)
+						    bool enableTracker, int frameUpdateInterval, bool evaluation,
+						    std::shared_ptr<struct input_BGRA_data> faceCrop)
 {
 	uint32_t width = frame->width;
 	uint32_t height = frame->height;
@@ -97,10 +98,12 @@ std::vector<double_t> DlibFaceDetection::detectFace(std::shared_ptr<struct input
 				startedTracking = true;
 			}
 		} else {
+			faceFound = false;
 			return std::vector<double_t>(3, 0.0); // No face detected
 		}
 	} else if (enableTracker) {
 		if (!faceDetected) {
+			faceFound = false;
 			return std::vector<double_t>(3, 0.0); // No face tracked
 		}
 		tracker.update(dlibImg);
@@ -142,14 +145,5 @@ std::vector<double_t> DlibFaceDetection::detectFace(std::shared_ptr<struct input
 		}
 	}
 
-	cv::Mat maskMat = cv::Mat::zeros(frameMat.size(), CV_8UC1);
-	cv::fillConvexPoly(maskMat, faceContour, cv::Scalar(255));
-	cv::fillConvexPoly(maskMat, leftEyes, cv::Scalar(0));
-	cv::fillConvexPoly(maskMat, rightEyes, cv::Scalar(0));
-	cv::fillConvexPoly(maskMat, mouth, cv::Scalar(0));
-
-	cv::Scalar meanRGB = cv::mean(frameMat, maskMat);
-	std::vector<double_t> avgRGB = {meanRGB[0], meanRGB[1], meanRGB[2]};
-
-	return avgRGB;
+	return maskedMean(frame, faceCrop, {faceContour}, {leftEyes, rightEyes, mouth});
 }
\ No newline at end of file
@@ -14,7 +14,8 @@ class DlibFaceDetection : public FaceDetection {
 public:
 	std::vector<double_t> detectFace(std::shared_ptr<struct input_BGRA_data> frame,
 					 std::vector<struct vec4> &faceCoordinates, bool enableDebugBoxes,
-					 bool enableTracker, int frameUpdateInterval, bool evaluation = false);
+					 bool enableTracker, int frameUpdateInterval, bool evaluation = false,
+					 std::shared_ptr<struct input_BGRA_data> faceCrop = nullptr) override;
 
 private:
 	void loadFiles(bool evaluation);
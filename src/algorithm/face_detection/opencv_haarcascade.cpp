@@ -52,11 +52,18 @@ static struct vec4 getNormalisedRect(const cv::Rect &region, uint32_t width, uin
 	return rect;
 }
 
+static std::vector<cv::Point> rectToPolygon(const cv::Rect &region)
+{
+	return {region.tl(), cv::Point(region.x + region.width, region.y), region.br(),
+		cv::Point(region.x, region.y + region.height)};
+}
+
 // Function to detect faces and create a mask
 std::vector<double_t> HaarCascadeFaceDetection::detectFace(std::shared_ptr<struct input_BGRA_data> frame,
 							   std::vector<struct vec4> &faceCoordinates,
 							   bool enableDebugBoxes, bool enableTracker,
-							   int frameUpdateInterval, bool evaluation)
+							   int frameUpdateInterval, bool evaluation,
+							   std::shared_ptr<struct input_BGRA_data> faceCrop)
 {
 	UNUSED_PARAMETER(frameUpdateInterval);
 	UNUSED_PARAMETER(enableTracker);
@@ -68,15 +75,27 @@ std::vector<double_t> HaarCascadeFaceDetection::detectFace(std::shared_ptr<struc
 	// Initialize the face cascade
 	initializeFaceCascade(evaluation);
 
+	bool resetFaceDetection = frameCount % 3 == 0;
+	frameCount++;
+
+	if (!resetFaceDetection) {
+		if (noFaceDetected || skinRegions.empty()) {
+			return std::vector<double_t>(3, 0.0);
+		}
+
+		// Reuse the regions found on the last detection frame
+		faceCoordinates = faceCoordinatesCopy;
+		return maskedMean(frame, faceCrop, skinRegions, excludedRegions);
+	} else {
+		frameCount = 0;
+	}
+
 	// Extract frame parameters
 	uint8_t *data = frame->data;
 	uint32_t width = frame->width;
 	uint32_t height = frame->height;
 	uint32_t linesize = frame->linesize;
 
-	// Initialize a 2D boolean mask
-	std::vector<std::vector<bool>> faceMask(height, std::vector<bool>(width, false));
-
 	// Create an OpenCV Mat for the BGRA frame
 	// `linesize` specifies the number of bytes per row, which can include padding
 	cv::Mat bgraFrame(height, linesize / 4, CV_8UC4, data);
@@ -88,26 +107,6 @@ std::vector<double_t> HaarCascadeFaceDetection::detectFace(std::shared_ptr<struc
 	cv::Mat bgrFrame;
 	cv::cvtColor(croppedBgraFrame, bgrFrame, cv::COLOR_BGRA2BGR);
 
-	bool resetFaceDetection = frameCount % 3 == 0;
-	frameCount++;
-
-	if (!resetFaceDetection) {
-		if (noFaceDetected || maskMat.empty()) {
-			return std::vector<double_t>(3, 0.0);
-		}
-
-		// Now compute the mean color in the face region (where maskMat is nonzero)
-		cv::Scalar meanRGB = cv::mean(bgrFrame, maskMat);
-
-		// Convert the result to a vector<double_t> (B, G, R order)
-		std::vector<double_t> avgRGB = {meanRGB[0], meanRGB[1], meanRGB[2]};
-
-		faceCoordinates = faceCoordinatesCopy;
-		return avgRGB;
-	} else {
-		frameCount = 0;
-	}
-
 	// Detect faces
 	std::vector<cv::Rect> faces;
 	faceCascade.detectMultiScale(bgrFrame, faces, 1.1, 10, 0, cv::Size(30, 30));
@@ -119,7 +118,9 @@ std::vector<double_t> HaarCascadeFaceDetection::detectFace(std::shared_ptr<struc
 		initialFace = faces[0]; // Assume first detected face is the target
 	} else {
 		noFaceDetected = true;
-		maskMat.release();           // Frees memory and makes it an empty matrix
+		faceFound = false;
+		skinRegions.clear();
+		excludedRegions.clear();
 		faceCoordinatesCopy.clear(); // Clears all elements, size becomes 0
 		// If no face detected, return empty mask
 		return std::vector<double_t>(3, 0.0);
@@ -189,29 +190,19 @@ std::vector<double_t> HaarCascadeFaceDetection::detectFace(std::shared_ptr<struc
 
 	faceCoordinatesCopy = faceCoordinates;
 
-	// Instead of returning a 2D boolean mask, create an OpenCV mask image
-	// that we will use to compute the average RGB.
-	maskMat = cv::Mat::zeros(bgrFrame.size(), CV_8UC1);
-
-	// Mark the entire face region (initialFace) as valid (white)
-	cv::rectangle(maskMat, initialFace, cv::Scalar(255), cv::FILLED);
-
-	// Remove (mask out) the detected left eye, right eye, and mouth regions by setting them to black.
+	// The whole face region is skin, apart from the detected left eye, right eye and mouth regions
+	skinRegions = {rectToPolygon(initialFace)};
+	excludedRegions.clear();
 	if (!leftEyes.empty()) {
-		cv::rectangle(maskMat, absoluteLeftEye, cv::Scalar(0), cv::FILLED);
+		excludedRegions.push_back(rectToPolygon(absoluteLeftEye));
 	}
 	if (!rightEyes.empty()) {
-		cv::rectangle(maskMat, absoluteRightEye, cv::Scalar(0), cv::FILLED);
+		excludedRegions.push_back(rectToPolygon(absoluteRightEye));
 	}
 	if (!mouths.empty()) {
-		cv::rectangle(maskMat, absoluteMouth, cv::Scalar(0), cv::FILLED);
+		excludedRegions.push_back(rectToPolygon(absoluteMouth));
 	}
 
-	// Now compute the mean color in the face region (where maskMat is nonzero)
-	cv::Scalar meanRGB = cv::mean(bgrFrame, maskMat);
-
-	// Convert the result to a vector<double_t> (B, G, R order)
-	std::vector<double_t> avgRGB = {meanRGB[0], meanRGB[1], meanRGB[2]};
-
-	return avgRGB;
-}
+	// Now compute the mean color in the face region
+	return maskedMean(frame, faceCrop, skinRegions, excludedRegions);
+}
\ No newline at end of file
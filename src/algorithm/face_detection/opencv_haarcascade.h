@@ -18,14 +18,15 @@ class HaarCascadeFaceDetection : public FaceDetection {
 public:
 	std::vector<double_t> detectFace(std::shared_ptr<struct input_BGRA_data> frame,
 					 std::vector<struct vec4> &faceCoordinates, bool enableDebugBoxes,
-					 bool enableTracker, int frameUpdateInterval, bool evaluation = false) override;
+					 bool enableTracker, int frameUpdateInterval, bool evaluation = false,
+					 std::shared_ptr<struct input_BGRA_data> faceCrop = nullptr) override;
 
 private:
 	void initializeFaceCascade(bool evaluation);
 	cv::CascadeClassifier faceCascade, mouthCascade, leftEyeCascade, rightEyeCascade;
 	bool cascadeLoaded = false;
 	bool noFaceDetected = false;
-	cv::Mat maskMat;
+	std::vector<std::vector<cv::Point>> skinRegions, excludedRegions;
 	int frameCount = 0;
 	std::vector<struct vec4> faceCoordinatesCopy;
 };
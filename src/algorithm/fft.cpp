@@ -0,0 +1,109 @@
+#include "fft.h"
+
+#include <cmath>
+#include <map>
+#include <mutex>
+
+using namespace std;
+
+int nextPowerOfTwo(int length)
+{
+	int size = 1;
+	while (size < length) {
+		size <<= 1;
+	}
+	return size;
+}
+
+shared_ptr<const FFTPlan> FFTPlan::get(int size)
+{
+	static mutex plansMutex;
+	static map<int, shared_ptr<const FFTPlan>> plans;
+
+	lock_guard<mutex> lock(plansMutex);
+	shared_ptr<const FFTPlan> &plan = plans[size];
+	if (!plan) {
+		plan = make_shared<const FFTPlan>(size);
+	}
+	return plan;
+}
+
+FFTPlan::FFTPlan(int size) : n(size)
+{
+	int half = n / 2;
+
+	bitReverse.resize(half);
+	int bits = 0;
+	while ((1 << bits) < half) {
+		++bits;
+	}
+	for (int i = 0; i < half; ++i) {
+		int reversed = 0;
+		for (int b = 0; b < bits; ++b) {
+			reversed |= ((i >> b) & 1) << (bits - 1 - b);
+		}
+		bitReverse[i] = reversed;
+	}
+
+	twiddles.resize(half / 2);
+	for (int j = 0; j < half / 2; ++j) {
+		twiddles[j] = polar(1.0, -2.0 * M_PI * j / half);
+	}
+
+	realSplit.resize(half + 1);
+	for (int k = 0; k <= half; ++k) {
+		realSplit[k] = polar(1.0, -2.0 * M_PI * k / n);
+	}
+}
+
+void FFTPlan::powerSpectrum(const double *input, int length, vector<complex<double>> &work, double *power) const
+{
+	int half = n / 2;
+	work.resize(half);
+
+	// Pack even samples into the real part and odd samples into the imaginary part, in bit-reversed order
+	for (int i = 0; i < half; ++i) {
+		int even = 2 * i;
+		double re = even < length ? input[even] : 0.0;
+		double im = even + 1 < length ? input[even + 1] : 0.0;
+		work[bitReverse[i]] = complex<double>(re, im);
+	}
+
+	// Iterative radix-2 complex transform of size n / 2
+	for (int len = 2; len <= half; len <<= 1) {
+		int step = half / len;
+		for (int start = 0; start < half; start += len) {
+			for (int j = 0; j < len / 2; ++j) {
+				complex<double> t = twiddles[j * step] * work[start + j + len / 2];
+				work[start + j + len / 2] = work[start + j] - t;
+				work[start + j] += t;
+			}
+		}
+	}
+
+	// Split the packed transform into the spectrum of the real input
+	for (int k = 0; k <= half; ++k) {
+		complex<double> z = work[k % half];
+		complex<double> zMirror = conj(work[(half - k) % half]);
+		complex<double> evenPart = 0.5 * (z + zMirror);
+		complex<double> oddPart = complex<double>(0.0, -0.5) * (z - zMirror);
+		power[k] = norm(evenPart + realSplit[k] * oddPart);
+	}
+}
+
+shared_ptr<const vector<double>> hannWindow(int length)
+{
+	static mutex windowsMutex;
+	static map<int, shared_ptr<const vector<double>>> windows;
+
+	lock_guard<mutex> lock(windowsMutex);
+	shared_ptr<const vector<double>> &window = windows[length];
+	if (!window) {
+		vector<double> values(length, 1.0);
+		for (int i = 0; i < length && length > 1; ++i) {
+			values[i] = 0.5 * (1 - cos(2 * M_PI * i / (length - 1)));
+		}
+		window = make_shared<const vector<double>>(move(values));
+	}
+	return window;
+}
@@ -0,0 +1,36 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <complex>
+#include <memory>
+#include <vector>
+
+// Real-input radix-2 FFT of a fixed power-of-two size. Plans are immutable and shared, so one plan per size is built
+// and reused by every estimator; the scratch buffer is owned by the caller.
+class FFTPlan {
+public:
+	// Cached plan for a power-of-two size of at least 4
+	static std::shared_ptr<const FFTPlan> get(int size);
+
+	int size() const { return n; }
+
+	// |X[k]|^2 for k = 0..size/2 of the first length samples of input, zero-padded to size
+	void powerSpectrum(const double *input, int length, std::vector<std::complex<double>> &work,
+			   double *power) const;
+
+	explicit FFTPlan(int size);
+
+private:
+	int n;
+	std::vector<int> bitReverse;                 // Of the half-size complex transform
+	std::vector<std::complex<double>> twiddles;  // exp(-2 pi i j / (n / 2)), j < n / 4
+	std::vector<std::complex<double>> realSplit; // exp(-2 pi i k / n), k <= n / 2
+};
+
+// Cached symmetric Hann window of the given length
+std::shared_ptr<const std::vector<double>> hannWindow(int length);
+
+// Smallest power of two that is at least length
+int nextPowerOfTwo(int length);
+
+#endif
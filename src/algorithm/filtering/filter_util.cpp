@@ -5,131 +5,51 @@
 using namespace std;
 using namespace Eigen;
 
-void butterworthBandpass(int order, double minHz, double maxHz, double fps, VectorXd &a, VectorXd &b)
+const vector<struct biquad> &bandpassSections(int fps)
 {
-	double nyquist = fps / 2.0;
-	double low = minHz / nyquist;
-	double high = maxHz / nyquist;
-
-	// Convert to pre-warped analog frequencies
-	double omega1 = tan(M_PI * low);
-	double omega2 = tan(M_PI * high);
-
-	// Get the center frequency and bandwidth
-	double omega0 = sqrt(omega1 * omega2);
-	double bandwidth = omega2 - omega1;
-
-	// Initialize coefficient vectors
-	a = VectorXd(order + 1);
-	b = VectorXd(order + 1);
-
-	// Compute coefficients (Butterworth poles in s-domain)
-	vector<double> A(order + 1, 0);
-	vector<double> B(order + 1, 0);
-
-	for (int i = 0; i <= order; ++i) {
-		double theta = M_PI * (2 * i + 1) / (2.0 * order);
-		double sigma = -omega0 * sin(theta);
-		double omega = omega0 * cos(theta);
-		double denominator = sigma * sigma + omega * omega + bandwidth * sigma;
-
-		B[i] = bandwidth / denominator;
-		A[i] = 1.0 - (2 * sigma / denominator);
-	}
-
-	// Convert to Eigen vectors
-	for (int i = 0; i <= order; ++i) {
-		b(i) = B[i];
-		a(i) = A[i];
-	}
+	return butterworthBandpassSos(BANDPASS_ORDER, BANDPASS_MIN_HZ, BANDPASS_MAX_HZ, fps);
 }
 
-VectorXd applyIIRFilter(const VectorXd &b, const VectorXd &a, const VectorXd &x)
+size_t sosScratchSize(Index rows, size_t numSections)
 {
-	size_t n = x.size();
-	VectorXd y(n);
+	return (static_cast<size_t>(rows) + numSections * 2) * SOS_LANES;
+}
 
-	// Ensure a(0) is 1, normalize otherwise
-	if (a(0) == 0) {
-		std::cerr << "Error: a(0) cannot be zero in IIR filter!" << std::endl;
-		return y.setConstant(n, NAN); // Return NaN-filled vector
+void sosFilterColumns(const vector<struct biquad> &sections, Ref<MatrixXd> signal, bool backward,
+		      vector<double> &scratch)
+{
+	int rows = static_cast<int>(signal.rows());
+	if (scratch.size() < sosScratchSize(rows, sections.size())) {
+		scratch.resize(sosScratchSize(rows, sections.size()));
 	}
+	double *frames = scratch.data();
+	double *state = frames + static_cast<size_t>(rows) * SOS_LANES;
 
-	VectorXd a_norm = a / a(0);
-	VectorXd b_norm = b / a(0);
+	for (Index first = 0; first < signal.cols(); first += SOS_LANES) {
+		Index lanes = min<Index>(SOS_LANES, signal.cols() - first);
 
-	for (int i = 0; i < static_cast<int>(n); ++i) {
-		y(i) = 0.0;
-
-		// Apply FIR part (b coefficients)
-		for (int j = 0; j < static_cast<int>(b.size()); ++j) {
-			if (i - j >= 0) {
-				y(i) += b_norm(j) * x(i - j);
+		// Interleave the columns so each frame holds one sample of every lane
+		fill(frames, frames + static_cast<size_t>(rows) * SOS_LANES, 0.0);
+		for (int i = 0; i < rows; ++i) {
+			for (Index lane = 0; lane < lanes; ++lane) {
+				frames[i * SOS_LANES + lane] = signal(i, first + lane);
 			}
 		}
 
-		// Apply IIR part (a coefficients)
-		for (int j = 1; j < static_cast<int>(a.size()); ++j) { // a[0] is already normalized
-			if (i - j >= 0) {
-				y(i) -= a_norm(j) * y(i - j);
+		fill(state, state + sections.size() * 2 * SOS_LANES, 0.0);
+		sosFilterLanes(sections, frames, rows, backward, state);
+
+		for (int i = 0; i < rows; ++i) {
+			for (Index lane = 0; lane < lanes; ++lane) {
+				signal(i, first + lane) = frames[i * SOS_LANES + lane];
 			}
 		}
 	}
-
-	return y;
-}
-
-MatrixXd forwardBackFilter(const VectorXd &b, const VectorXd &a, const MatrixXd &x)
-{
-	int rows = static_cast<int>(x.rows()), cols = static_cast<int>(x.cols());
-	MatrixXd y(rows, cols);
-
-	// Apply filtering in forward direction
-	for (int j = 0; j < cols; ++j) {
-		y.col(j) = applyIIRFilter(b, a, x.col(j));
-	}
-
-	// Apply filtering in backward direction
-	for (int j = 0; j < cols; ++j) {
-		VectorXd reversed = y.col(j).reverse();
-		reversed = applyIIRFilter(b, a, reversed);
-		y.col(j) = reversed.reverse();
-	}
-
-	return y;
 }
 
-vector<vector<double_t>> bpFilter(vector<vector<double_t>> signal, int fps)
+void bpFilter(Ref<MatrixXd> signal, int fps, vector<double> &scratch)
 {
-
-	int order = 6;
-	double minHz = 0.65;
-	double maxHz = 3.0;
-
-	size_t rows = signal.size();
-	size_t cols = signal[0].size();
-	MatrixXd sig((int)rows, (int)cols);
-
-	for (int i = 0; i < static_cast<int>(rows); ++i) {
-		for (int j = 0; j < static_cast<int>(cols); ++j) {
-			sig(i, j) = signal[i][j];
-		}
-	}
-
-	sig.transposeInPlace();
-
-	VectorXd b, a;
-	butterworthBandpass(order, minHz, maxHz, fps, a, b);
-
-	MatrixXd y = forwardBackFilter(b, a, sig);
-	y.transposeInPlace();
-
-	vector<vector<double_t>> result(rows, vector<double>(cols));
-	for (int i = 0; i < static_cast<int>(rows); ++i) {
-		for (int j = 0; j < static_cast<int>(cols); ++j) {
-			result[i][j] = y(i, j);
-		}
-	}
-
-	return result;
+	const vector<struct biquad> &sections = bandpassSections(fps);
+	sosFilterColumns(sections, signal, false, scratch);
+	sosFilterColumns(sections, signal, true, scratch);
 }
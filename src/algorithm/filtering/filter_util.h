@@ -6,12 +6,24 @@
 #include <cmath>
 #include <iostream>
 
+#include "sos_filter.h"
+
 using namespace Eigen;
 using namespace std;
 
-void butterworthBandpass(int order, double minHz, double maxHz, double fps, VectorXd &a, VectorXd &b);
-VectorXd applyIIRFilter(const VectorXd &b, const VectorXd &a, const VectorXd &x);
-MatrixXd forwardBackFilter(const VectorXd &b, const VectorXd &a, const MatrixXd &x);
-vector<vector<double_t>> bpFilter(vector<vector<double_t>> signal, int fps);
+// Heart rate band edges and prototype order of the pre and post band-pass
+#define BANDPASS_ORDER 6
+#define BANDPASS_MIN_HZ 0.65
+#define BANDPASS_MAX_HZ 3.0
+
+const vector<struct biquad> &bandpassSections(int fps);
+// Scratch sosFilterColumns needs for rows samples and a cascade of numSections
+size_t sosScratchSize(Index rows, size_t numSections);
+// Runs the cascade over every column of signal in place, SOS_LANES columns at a time, starting at rest. scratch only
+// grows if it is smaller than sosScratchSize
+void sosFilterColumns(const vector<struct biquad> &sections, Ref<MatrixXd> signal, bool backward,
+		      vector<double> &scratch);
+// Band-passes every column of signal along time, forward then backward so the phase is not shifted
+void bpFilter(Ref<MatrixXd> signal, int fps, vector<double> &scratch);
 
 #endif
\ No newline at end of file
@@ -4,22 +4,10 @@
 using namespace std;
 using namespace Eigen;
 
-vector<double_t> applyPostFilter(vector<double_t> signal, int filter, int fps)
+void BandpassPostFilter::apply(PipelineData &data)
 {
-	if (filter == 0) {
-		return signal;
-	} else if (filter == 1) { // Band pass
-		vector<vector<double_t>> newSignal(signal.size(), vector<double_t>(1, 0.0));
-		for (size_t i = 0; i < signal.size(); ++i) {
-			newSignal[i][0] = signal[i];
-		}
-		vector<vector<double_t>> expandedFilter = bpFilter(newSignal, fps);
-		vector<double_t> res(signal.size());
-		for (size_t i = 0; i < signal.size(); ++i) {
-			res[i] = expandedFilter[i][0];
-		}
-		return res;
+	if (data.size() > 0) {
+		PipelineData::PulseView ppg = data.ppg();
+		bpFilter(ppg, data.fps, data.filterScratch);
 	}
-
-	return {};
-}
\ No newline at end of file
+}
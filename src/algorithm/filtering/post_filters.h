@@ -6,6 +6,15 @@
 #include <cmath>
 #include <iostream>
 
-std::vector<double_t> applyPostFilter(std::vector<double_t> signal, int filter, int fps);
+#include "algorithm/pipeline.h"
+
+// Post-filter stages filter the pulse signal along time, in place
+struct NoPostFilter {
+	static void apply(PipelineData &) {}
+};
+
+struct BandpassPostFilter {
+	static void apply(PipelineData &data);
+};
 
 #endif
\ No newline at end of file
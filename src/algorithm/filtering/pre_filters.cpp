@@ -4,78 +4,101 @@
 using namespace std;
 using namespace Eigen;
 
-vector<double_t> detrendSignal(const vector<double_t> &signal)
+void detrendSignal(Ref<VectorXd> signal)
 {
-	int n = static_cast<int>(signal.size());
+	Index n = signal.size();
 	if (n < 2)
-		return signal; // Not enough points to perform detrending
+		return; // Not enough points to perform detrending
 
-	VectorXd x(n), y(n);
-
-	// Construct x (time indices) and y (signal values)
-	for (int i = 0; i < n; ++i) {
-		x(i) = i;         // Time index
-		y(i) = signal[i]; // Original signal
+	// Closed form fit of y = a + bt with t the sample index
+	double meanT = (n - 1) / 2.0;
+	double meanY = signal.mean();
+	double covTY = 0.0, varT = 0.0;
+	for (Index i = 0; i < n; ++i) {
+		covTY += (i - meanT) * (signal(i) - meanY);
+		varT += (i - meanT) * (i - meanT);
 	}
-
-	// Construct the design matrix for Least Squares
-	MatrixXd X(n, 2);
-	X.col(0).setOnes(); // First column is all ones (for intercept)
-	X.col(1) = x;       // Second column is time indices
-
-	// Compute the least squares solution for the linear fit (Ax = b)
-	VectorXd coeffs = (X.transpose() * X).ldlt().solve(X.transpose() * y);
-
-	// Compute the linear trend (y = a + bt)
-	VectorXd trend = X * coeffs;
+	double slope = covTY / varT;
 
 	// Subtract the trend from the signal
-	vector<double_t> detrendedSignal(n);
-	for (int i = 0; i < n; ++i) {
-		detrendedSignal[i] = signal[i] - trend(i);
+	for (Index i = 0; i < n; ++i) {
+		signal(i) -= meanY + slope * (i - meanT);
 	}
+}
 
-	return detrendedSignal;
+void DetrendPreFilter::apply(PipelineData &data)
+{
+	PipelineData::ColourView rgb = data.rgb();
+	for (Index c = 0; c < rgb.cols(); ++c) {
+		detrendSignal(rgb.col(c));
+	}
 }
 
-vector<double_t> zeroMeanFilter(const vector<double_t> &signal)
+void StreamedBandpassPreFilter::applyToPulse(PipelineData &data)
 {
-	if (signal.empty())
-		return signal; // Handle empty input
+	if (data.size() > 0) {
+		PipelineData::PulseView ppg = data.ppg();
+		bpFilter(ppg, data.fps, data.filterScratch);
+	}
+}
+
+class BandpassStream : public PreFilterStream {
+public:
+	explicit BandpassStream(int fps) : sos(bandpassSections(fps), 3) {}
 
-	// Compute the mean
-	double mean = accumulate(signal.begin(), signal.end(), 0.0) / signal.size();
+	void settle(const double *rgb) override { sos.settle(rgb); }
+	void process(double *rgb, double) override { sos.process(rgb); }
+	const SignalBuffer &colours(const SignalBuffer &processed) override { return processed; }
 
-	// Subtract the mean from each sample
-	vector<double_t> zeroMeanSignal(signal.size());
-	for (size_t i = 0; i < signal.size(); ++i) {
-		zeroMeanSignal[i] = signal[i] - mean;
+protected:
+	SosFilter sos;
+};
+
+// Keeps a copy of the colours that is filtered backward again, for each estimate, over the samples since the last one
+// and those before them that the new ones still reach through the filter's impulse response
+class ZeroPhaseBandpassStream : public BandpassStream {
+public:
+	ZeroPhaseBandpassStream(int fps, int capacity)
+		: BandpassStream(fps),
+		  backward(capacity),
+		  settling(sos.settlingSamples(0.01)),
+		  tail(capacity, 3),
+		  scratch(sosScratchSize(capacity, sos.getSections().size()))
+	{
 	}
 
-	return zeroMeanSignal;
-}
+	void process(double *rgb, double time) override
+	{
+		sos.process(rgb);
+		backward.push(rgb, time);
+		newSamples++;
+	}
 
-vector<vector<double_t>> applyPreFilter(vector<vector<double_t>> signal, int filter, int fps)
-{
-	if (filter == 0) {
-		return signal;
-	} else if (filter == 1) { // Band pass
-		return bpFilter(signal, fps);
-	} else if (filter == 2) {
-		// Apply Detrending on each RGB channel
-		for (size_t i = 0; i < signal.size(); ++i) {
-			signal[i] = detrendSignal(signal[i]);
-		}
-		return signal;
-	} else if (filter == 3) {
-		// Apply Zero-Mean Filtering on each channel
-		for (size_t i = 0; i < signal.size(); ++i) {
-			if (!signal[i].empty()) {
-				signal[i] = zeroMeanFilter(signal[i]);
-			}
-		}
-		return signal;
+	const SignalBuffer &colours(const SignalBuffer &processed) override
+	{
+		int rows = min(processed.size(), newSamples + settling);
+		newSamples = 0;
+		Block<MatrixXd> tailRows = tail.topRows(rows);
+		tailRows = processed.colours(rows);
+		sosFilterColumns(sos.getSections(), tailRows, true, scratch);
+		backward.replaceLatest(tailRows);
+		return backward;
 	}
 
-	return {};
+private:
+	SignalBuffer backward;
+	int settling;
+	int newSamples = 0;
+	MatrixXd tail;
+	vector<double> scratch;
+};
+
+unique_ptr<PreFilterStream> StreamedBandpassPreFilter::createStream(int fps, int)
+{
+	return make_unique<BandpassStream>(fps);
+}
+
+unique_ptr<PreFilterStream> ZeroPhaseBandpassPreFilter::createStream(int fps, int capacity)
+{
+	return make_unique<ZeroPhaseBandpassStream>(fps, capacity);
 }
@@ -5,8 +5,68 @@
 #include <Eigen/Dense>
 #include <cmath>
 #include <iostream>
+#include <memory>
 #include <numeric>
 
-std::vector<std::vector<double_t>> applyPreFilter(std::vector<std::vector<double_t>> signal, int filter, int fps);
+#include "algorithm/pipeline.h"
+
+// Subtracts the least squares line through the signal
+void detrendSignal(Eigen::Ref<Eigen::VectorXd> signal);
+
+// Pre-filter stages filter every column (colour channel) of the colours along time, in place. They also say whether the
+// colours' covariance survives them and whether they centre the colours, so PCA knows if the buffer's running
+// statistics still apply. Stages that filter the samples as they arrive create a stream, the others return null. PPG
+// stages that build their pulse without the colours have the pulse pre-filtered instead, with applyToPulse.
+struct NoPreFilter {
+	static constexpr bool KEEPS_COVARIANCE = true;
+	static constexpr bool CENTRES = false;
+	static std::unique_ptr<PreFilterStream> createStream(int, int) { return nullptr; }
+	static void apply(PipelineData &) {}
+	static void applyToPulse(PipelineData &) {}
+};
+
+// Causal band-pass, each sample is filtered once as it arrives so there is nothing left to do for each estimate
+struct StreamedBandpassPreFilter {
+	static constexpr bool KEEPS_COVARIANCE = true;
+	static constexpr bool CENTRES = false;
+	static std::unique_ptr<PreFilterStream> createStream(int fps, int capacity);
+	static void apply(PipelineData &) {}
+	// A pulse built from the raw colours has no stream to start from, so its window is band-passed both ways
+	static void applyToPulse(PipelineData &data);
+};
+
+// Band-pass without phase shift. The samples are filtered forward as they arrive, and for each estimate backward over
+// the latest ones, as far back as the new samples still reach through the filter
+struct ZeroPhaseBandpassPreFilter {
+	static constexpr bool KEEPS_COVARIANCE = true;
+	static constexpr bool CENTRES = false;
+	static std::unique_ptr<PreFilterStream> createStream(int fps, int capacity);
+	static void apply(PipelineData &) {}
+	static void applyToPulse(PipelineData &data) { StreamedBandpassPreFilter::applyToPulse(data); }
+};
+
+struct DetrendPreFilter {
+	static constexpr bool KEEPS_COVARIANCE = false;
+	static constexpr bool CENTRES = true;
+	static std::unique_ptr<PreFilterStream> createStream(int, int) { return nullptr; }
+	static void apply(PipelineData &data);
+	static void applyToPulse(PipelineData &data) { detrendSignal(data.ppg()); }
+};
+
+struct ZeroMeanPreFilter {
+	static constexpr bool KEEPS_COVARIANCE = true;
+	static constexpr bool CENTRES = true;
+	static std::unique_ptr<PreFilterStream> createStream(int, int) { return nullptr; }
+	static void apply(PipelineData &data)
+	{
+		PipelineData::ColourView rgb = data.rgb();
+		rgb.rowwise() -= rgb.colwise().mean();
+	}
+	static void applyToPulse(PipelineData &data)
+	{
+		PipelineData::PulseView ppg = data.ppg();
+		ppg.array() -= ppg.mean();
+	}
+};
 
 #endif
\ No newline at end of file
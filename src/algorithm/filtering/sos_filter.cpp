@@ -0,0 +1,149 @@
+#include "sos_filter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <tuple>
+
+using namespace std;
+
+static vector<struct biquad> designButterworthBandpass(int order, double minHz, double maxHz, double fps)
+{
+	vector<struct biquad> sections;
+	if (order < 1 || fps <= 0.0 || minHz <= 0.0 || maxHz <= minHz || maxHz >= fps / 2.0) {
+		return sections;
+	}
+
+	// Pre-warped analog band edges for the bilinear transform
+	double fs2 = 2.0 * fps;
+	double w1 = fs2 * tan(M_PI * minHz / fps);
+	double w2 = fs2 * tan(M_PI * maxHz / fps);
+	double bandwidth = w2 - w1;
+	double centreSquared = w1 * w2;
+
+	// Each prototype pole p becomes the two roots of s^2 - p * bandwidth * s + centre^2, which are mapped to the
+	// z-plane. Complex poles are kept from the upper half plane only, their conjugates complete each section
+	vector<complex<double>> complexPoles;
+	vector<double> realPoles;
+	for (int k = 0; k < order; ++k) {
+		complex<double> p = polar(1.0, M_PI * (2.0 * k + order + 1) / (2.0 * order));
+		complex<double> half = p * bandwidth / 2.0;
+		complex<double> root = sqrt(half * half - centreSquared);
+		for (complex<double> s : {half + root, half - root}) {
+			complex<double> z = (fs2 + s) / (fs2 - s);
+			if (abs(z.imag()) < 1e-12) {
+				realPoles.push_back(z.real());
+			} else if (z.imag() > 0.0) {
+				complexPoles.push_back(z);
+			}
+		}
+	}
+
+	// Every section has one zero at z = 1 and one at z = -1
+	for (const complex<double> &z : complexPoles) {
+		sections.push_back({1.0, 0.0, -1.0, -2.0 * z.real(), norm(z)});
+	}
+	for (size_t i = 0; i + 1 < realPoles.size(); i += 2) {
+		double sum = realPoles[i] + realPoles[i + 1];
+		double product = realPoles[i] * realPoles[i + 1];
+		sections.push_back({1.0, 0.0, -1.0, -sum, product});
+	}
+
+	// Unit gain at the centre of the band, spread evenly over the sections
+	double centreHz = fps * atan(sqrt(centreSquared) / fs2) / M_PI;
+	double gain = pow(sosMagnitude(sections, centreHz, fps), -1.0 / sections.size());
+	for (struct biquad &section : sections) {
+		section.b0 *= gain;
+		section.b1 *= gain;
+		section.b2 *= gain;
+	}
+
+	return sections;
+}
+
+const vector<struct biquad> &butterworthBandpassSos(int order, double minHz, double maxHz, double fps)
+{
+	static mutex designsMutex;
+	static map<tuple<int, double, double, double>, vector<struct biquad>> designs;
+
+	lock_guard<mutex> lock(designsMutex);
+	auto key = make_tuple(order, minHz, maxHz, fps);
+	auto design = designs.find(key);
+	if (design == designs.end()) {
+		design = designs.emplace(key, designButterworthBandpass(order, minHz, maxHz, fps)).first;
+	}
+	// Designs are never removed, so the reference stays valid
+	return design->second;
+}
+
+double sosMagnitude(const vector<struct biquad> &sections, double hz, double fps)
+{
+	complex<double> zInv = polar(1.0, -2.0 * M_PI * hz / fps);
+	complex<double> response = 1.0;
+	for (const struct biquad &s : sections) {
+		response *= (s.b0 + s.b1 * zInv + s.b2 * zInv * zInv) / (1.0 + s.a1 * zInv + s.a2 * zInv * zInv);
+	}
+	return abs(response);
+}
+
+SosFilter::SosFilter(vector<struct biquad> sections, int numChannels)
+	: sections(std::move(sections)),
+	  numChannels(numChannels)
+{
+	reset();
+}
+
+void SosFilter::reset()
+{
+	int numGroups = (numChannels + SOS_LANES - 1) / SOS_LANES;
+	state.assign(static_cast<size_t>(numGroups) * sections.size() * 2 * SOS_LANES, 0.0);
+}
+
+void SosFilter::settle(const double *samples)
+{
+	for (int c = 0; c < numChannels; ++c) {
+		double *z = state.data() + (c / SOS_LANES) * sections.size() * 2 * SOS_LANES + c % SOS_LANES;
+		double x = samples[c];
+		for (const struct biquad &s : sections) {
+			double y = x * (s.b0 + s.b1 + s.b2) / (1.0 + s.a1 + s.a2);
+			z[SOS_LANES] = s.b2 * x - s.a2 * y;
+			z[0] = s.b1 * x - s.a1 * y + z[SOS_LANES];
+			x = y;
+			z += 2 * SOS_LANES;
+		}
+	}
+}
+
+void SosFilter::process(double *samples)
+{
+	for (int group = 0; group * SOS_LANES < numChannels; ++group) {
+		int lanes = min(SOS_LANES, numChannels - group * SOS_LANES);
+		double frame[SOS_LANES] = {};
+		copy(samples + group * SOS_LANES, samples + group * SOS_LANES + lanes, frame);
+		sosFilterLanes(sections, frame, 1, false, state.data() + group * sections.size() * 2 * SOS_LANES);
+		copy(frame, frame + lanes, samples + group * SOS_LANES);
+	}
+}
+
+int SosFilter::settlingSamples(double tolerance) const
+{
+	double radius = 0.0;
+	for (const struct biquad &s : sections) {
+		double discriminant = s.a1 * s.a1 - 4.0 * s.a2;
+		if (discriminant < 0.0) {
+			radius = max(radius, sqrt(s.a2));
+		} else {
+			radius = max(radius, (fabs(s.a1) + sqrt(discriminant)) / 2.0);
+		}
+	}
+	if (radius <= 0.0) {
+		return 0;
+	}
+	if (radius >= 1.0) {
+		return numeric_limits<int>::max();
+	}
+	return static_cast<int>(ceil(log(tolerance) / log(radius)));
+}
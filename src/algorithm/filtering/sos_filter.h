@@ -0,0 +1,53 @@
+#ifndef SOS_FILTER_H
+#define SOS_FILTER_H
+
+#include <vector>
+
+// One second-order section, normalised so a0 is 1
+struct biquad {
+	double b0, b1, b2;
+	double a1, a2;
+};
+
+// Butterworth band-pass from a low-pass prototype of the given order, as order second-order sections. Empty if the
+// band does not fit below the Nyquist frequency. Designs are cached, so this is cheap to call for every estimate
+const std::vector<struct biquad> &butterworthBandpassSos(int order, double minHz, double maxHz, double fps);
+
+// Magnitude of the cascade's frequency response at hz
+double sosMagnitude(const std::vector<struct biquad> &sections, double hz, double fps);
+
+// Channels filtered in lockstep, R, G, B and one spare
+#define SOS_LANES 4
+
+// Runs the cascade over numFrames frames of SOS_LANES interleaved samples in place, last frame first if backward is
+// set. state holds 2 * SOS_LANES delays per section and carries over between calls. Uses AVX, SSE2 or NEON as the
+// CPU allows, chosen once at runtime
+void sosFilterLanes(const std::vector<struct biquad> &sections, double *frames, int numFrames, bool backward,
+		    double *state);
+
+// Cascade of biquads over several channels that keeps each channel's state between calls, so every sample is
+// filtered once as it arrives instead of the whole window being filtered again for each estimate
+class SosFilter {
+public:
+	SosFilter() = default;
+	SosFilter(std::vector<struct biquad> sections, int numChannels);
+
+	// Returns every channel to rest
+	void reset();
+	// Sets each channel's state as if its sample had been the input forever, so a signal's offset causes no step
+	void settle(const double *samples);
+	bool empty() const { return sections.empty(); }
+	const std::vector<struct biquad> &getSections() const { return sections; }
+
+	// Filters one new sample of each channel in place
+	void process(double *samples);
+	// Samples after which an impulse has decayed below tolerance of its peak, from the slowest pole
+	int settlingSamples(double tolerance) const;
+
+private:
+	std::vector<struct biquad> sections;
+	int numChannels = 0;
+	std::vector<double> state; // Transposed direct form II delays, per group of SOS_LANES channels and section
+};
+
+#endif
@@ -0,0 +1,182 @@
+#include "sos_filter.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SOS_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define SOS_NEON 1
+#include <arm_neon.h>
+#endif
+
+// MSVC compiles any intrinsic without extra flags, GCC and Clang need the function to be built for AVX
+#if defined(SOS_X86) && !defined(_MSC_VER)
+#define SOS_TARGET_AVX __attribute__((target("avx")))
+#else
+#define SOS_TARGET_AVX
+#endif
+
+using namespace std;
+
+// Every kernel runs one section at a time over all frames, so the section's coefficients and state stay in registers.
+// Frames are visited last to first when backward is set.
+typedef void (*sosLanesKernel)(const struct biquad *sections, int numSections, double *frames, int numFrames,
+			       bool backward, double *state);
+
+#if !defined(SOS_X86) && !defined(SOS_NEON)
+static void sosLanesScalar(const struct biquad *sections, int numSections, double *frames, int numFrames,
+			   bool backward, double *state)
+{
+	int step = backward ? -SOS_LANES : SOS_LANES;
+	double *first = backward ? frames + (numFrames - 1) * SOS_LANES : frames;
+	for (int s = 0; s < numSections; ++s) {
+		const struct biquad &q = sections[s];
+		double *z1 = state + s * 2 * SOS_LANES;
+		double *z2 = z1 + SOS_LANES;
+		for (int lane = 0; lane < SOS_LANES; ++lane) {
+			double *frame = first + lane;
+			for (int f = 0; f < numFrames; ++f, frame += step) {
+				double x = *frame;
+				double y = q.b0 * x + z1[lane];
+				z1[lane] = q.b1 * x - q.a1 * y + z2[lane];
+				z2[lane] = q.b2 * x - q.a2 * y;
+				*frame = y;
+			}
+		}
+	}
+}
+#endif
+
+#ifdef SOS_X86
+// Two lanes per register, SSE2 is always available on x86-64
+static void sosLanesSse2(const struct biquad *sections, int numSections, double *frames, int numFrames, bool backward,
+			 double *state)
+{
+	int step = backward ? -SOS_LANES : SOS_LANES;
+	double *first = backward ? frames + (numFrames - 1) * SOS_LANES : frames;
+	for (int s = 0; s < numSections; ++s) {
+		const struct biquad &q = sections[s];
+		__m128d b0 = _mm_set1_pd(q.b0), b1 = _mm_set1_pd(q.b1), b2 = _mm_set1_pd(q.b2);
+		__m128d a1 = _mm_set1_pd(q.a1), a2 = _mm_set1_pd(q.a2);
+		double *z = state + s * 2 * SOS_LANES;
+		__m128d z1Lo = _mm_loadu_pd(z), z1Hi = _mm_loadu_pd(z + 2);
+		__m128d z2Lo = _mm_loadu_pd(z + 4), z2Hi = _mm_loadu_pd(z + 6);
+
+		double *frame = first;
+		for (int f = 0; f < numFrames; ++f, frame += step) {
+			__m128d xLo = _mm_loadu_pd(frame), xHi = _mm_loadu_pd(frame + 2);
+			__m128d yLo = _mm_add_pd(_mm_mul_pd(b0, xLo), z1Lo);
+			__m128d yHi = _mm_add_pd(_mm_mul_pd(b0, xHi), z1Hi);
+			z1Lo = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(b1, xLo), _mm_mul_pd(a1, yLo)), z2Lo);
+			z1Hi = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(b1, xHi), _mm_mul_pd(a1, yHi)), z2Hi);
+			z2Lo = _mm_sub_pd(_mm_mul_pd(b2, xLo), _mm_mul_pd(a2, yLo));
+			z2Hi = _mm_sub_pd(_mm_mul_pd(b2, xHi), _mm_mul_pd(a2, yHi));
+			_mm_storeu_pd(frame, yLo);
+			_mm_storeu_pd(frame + 2, yHi);
+		}
+
+		_mm_storeu_pd(z, z1Lo);
+		_mm_storeu_pd(z + 2, z1Hi);
+		_mm_storeu_pd(z + 4, z2Lo);
+		_mm_storeu_pd(z + 6, z2Hi);
+	}
+}
+
+// All four lanes in one register
+SOS_TARGET_AVX static void sosLanesAvx(const struct biquad *sections, int numSections, double *frames, int numFrames,
+				       bool backward, double *state)
+{
+	int step = backward ? -SOS_LANES : SOS_LANES;
+	double *first = backward ? frames + (numFrames - 1) * SOS_LANES : frames;
+	for (int s = 0; s < numSections; ++s) {
+		const struct biquad &q = sections[s];
+		__m256d b0 = _mm256_set1_pd(q.b0), b1 = _mm256_set1_pd(q.b1), b2 = _mm256_set1_pd(q.b2);
+		__m256d a1 = _mm256_set1_pd(q.a1), a2 = _mm256_set1_pd(q.a2);
+		double *z = state + s * 2 * SOS_LANES;
+		__m256d z1 = _mm256_loadu_pd(z), z2 = _mm256_loadu_pd(z + SOS_LANES);
+
+		double *frame = first;
+		for (int f = 0; f < numFrames; ++f, frame += step) {
+			__m256d x = _mm256_loadu_pd(frame);
+			__m256d y = _mm256_add_pd(_mm256_mul_pd(b0, x), z1);
+			z1 = _mm256_add_pd(_mm256_sub_pd(_mm256_mul_pd(b1, x), _mm256_mul_pd(a1, y)), z2);
+			z2 = _mm256_sub_pd(_mm256_mul_pd(b2, x), _mm256_mul_pd(a2, y));
+			_mm256_storeu_pd(frame, y);
+		}
+
+		_mm256_storeu_pd(z, z1);
+		_mm256_storeu_pd(z + SOS_LANES, z2);
+	}
+}
+
+static bool cpuHasAvx()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	bool osSavesYmm = (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6;
+	return osSavesYmm && (info[2] & (1 << 28));
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx");
+#endif
+}
+#endif
+
+#ifdef SOS_NEON
+// Two lanes per register, NEON is always available on AArch64
+static void sosLanesNeon(const struct biquad *sections, int numSections, double *frames, int numFrames, bool backward,
+			 double *state)
+{
+	int step = backward ? -SOS_LANES : SOS_LANES;
+	double *first = backward ? frames + (numFrames - 1) * SOS_LANES : frames;
+	for (int s = 0; s < numSections; ++s) {
+		const struct biquad &q = sections[s];
+		float64x2_t b0 = vdupq_n_f64(q.b0), b1 = vdupq_n_f64(q.b1), b2 = vdupq_n_f64(q.b2);
+		float64x2_t a1 = vdupq_n_f64(q.a1), a2 = vdupq_n_f64(q.a2);
+		double *z = state + s * 2 * SOS_LANES;
+		float64x2_t z1Lo = vld1q_f64(z), z1Hi = vld1q_f64(z + 2);
+		float64x2_t z2Lo = vld1q_f64(z + 4), z2Hi = vld1q_f64(z + 6);
+
+		double *frame = first;
+		for (int f = 0; f < numFrames; ++f, frame += step) {
+			float64x2_t xLo = vld1q_f64(frame), xHi = vld1q_f64(frame + 2);
+			float64x2_t yLo = vaddq_f64(vmulq_f64(b0, xLo), z1Lo);
+			float64x2_t yHi = vaddq_f64(vmulq_f64(b0, xHi), z1Hi);
+			z1Lo = vaddq_f64(vsubq_f64(vmulq_f64(b1, xLo), vmulq_f64(a1, yLo)), z2Lo);
+			z1Hi = vaddq_f64(vsubq_f64(vmulq_f64(b1, xHi), vmulq_f64(a1, yHi)), z2Hi);
+			z2Lo = vsubq_f64(vmulq_f64(b2, xLo), vmulq_f64(a2, yLo));
+			z2Hi = vsubq_f64(vmulq_f64(b2, xHi), vmulq_f64(a2, yHi));
+			vst1q_f64(frame, yLo);
+			vst1q_f64(frame + 2, yHi);
+		}
+
+		vst1q_f64(z, z1Lo);
+		vst1q_f64(z + 2, z1Hi);
+		vst1q_f64(z + 4, z2Lo);
+		vst1q_f64(z + 6, z2Hi);
+	}
+}
+#endif
+
+static sosLanesKernel selectKernel()
+{
+#if defined(SOS_X86)
+	return cpuHasAvx() ? sosLanesAvx : sosLanesSse2;
+#elif defined(SOS_NEON)
+	return sosLanesNeon;
+#else
+	return sosLanesScalar;
+#endif
+}
+
+void sosFilterLanes(const vector<struct biquad> &sections, double *frames, int numFrames, bool backward,
+		    double *state)
+{
+	static const sosLanesKernel kernel = selectKernel();
+	if (numFrames > 0 && !sections.empty()) {
+		kernel(sections.data(), static_cast<int>(sections.size()), frames, numFrames, backward, state);
+	}
+}
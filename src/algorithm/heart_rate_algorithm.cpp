@@ -1,7 +1,9 @@
 #include "heart_rate_algorithm.h"
 #include "plugin-support.h"
 #include "filtering/pre_filters.h"
-#include "filtering/post_filters.h"
+#include "filtering/filter_util.h"
+#include "fft.h"
+#include "pipeline.h"
 #include "heart_rate_source.h"
 
 #include <obs-module.h>
@@ -9,16 +11,15 @@
 #include <string>
 #include <cstdlib>
 #include <cmath>
+#include <limits>
 #include <util/platform.h>
 
 using namespace std;
 using namespace Eigen;
 using FrameRGB = vector<vector<vector<uint8_t>>>;
-using Windows = vector<vector<vector<double_t>>>;
-using Window = vector<vector<double_t>>;
 
 // Calculating the average/mean RGB values of a frame
-vector<double_t> MovingAvg::averageRGB(FrameRGB rgb, vector<vector<bool>> skinKey)
+vector<double_t> MovingAvg::averageRGB(const FrameRGB &rgb, const vector<vector<bool>> &skinKey)
 {
 	double sumR = 0.0, sumG = 0.0, sumB = 0.0;
 	double count = 0;
@@ -48,250 +49,501 @@ vector<double_t> MovingAvg::averageRGB(FrameRGB rgb, vector<vector<bool>> skinKe
 	return {0.0, 0.0, 0.0};
 }
 
-vector<double_t> green(Window windowsRGB)
+FrameRGB extractRGB(std::shared_ptr<struct input_BGRA_data> bgraData)
 {
-	vector<double_t> framesG;
-	for (int i = 0; i < static_cast<int>(windowsRGB.size()); i++) {
-		framesG.push_back(windowsRGB[i][1]);
-	}
+	uint8_t *data = bgraData->data;
+	uint32_t width = bgraData->width;
+	uint32_t height = bgraData->height;
+	uint32_t linesize = bgraData->linesize;
 
-	return framesG;
-}
+	FrameRGB frameRGB(height, vector<vector<uint8_t>>(width));
 
-vector<double_t> pca(Window windowsRGB)
-{
-	int numSamples = static_cast<int>(windowsRGB.size());
-	int numFeatures = 3;
+	for (uint32_t y = 0; y < height; ++y) {
+		for (uint32_t x = 0; x < width; ++x) {
+			uint8_t B = data[y * linesize + x * 4];
+			uint8_t G = data[y * linesize + x * 4 + 1];
+			uint8_t R = data[y * linesize + x * 4 + 2];
 
-	MatrixXd mat(numSamples, numFeatures);
-	for (int i = 0; i < numSamples; ++i) {
-		for (int j = 0; j < numFeatures; ++j) {
-			mat(i, j) = windowsRGB[i][j];
+			frameRGB[y][x] = {R, G, B};
 		}
 	}
 
-	VectorXd mean = mat.colwise().mean();
-	MatrixXd centered = mat.rowwise() - mean.transpose();
-
-	MatrixXd cov = (centered.transpose() * centered) / double(numSamples - 1);
-	SelfAdjointEigenSolver<MatrixXd> solver(cov);
-	MatrixXd eigenVects = solver.eigenvectors();
-
-	VectorXd pc = eigenVects.col(numFeatures - 1);
-	VectorXd transformed = centered * pc;
-
-	vector<double_t> result(transformed.data(), transformed.data() + transformed.size());
-	return result;
+	return frameRGB;
 }
 
-vector<double_t> chrom(Window windowsRGB)
+// Heart rate band searched by the spectral estimators, in BPM
+static const double MIN_HEART_RATE = 55;
+static const double MAX_HEART_RATE = 200;
+// POS window, long enough to hold one cycle at the lowest heart rate
+static const double POS_WINDOW_SECONDS = 1.6;
+// Signal needed before a provisional estimate is made during calibration, in seconds
+static const double PROVISIONAL_SECONDS = 2.0;
+// Lags whose autocorrelation is this close to the strongest are taken as the period, so the shortest period wins
+// over its multiples
+static const double AUTOCORRELATION_PEAK_RATIO = 0.8;
+// The beat band-pass starts from the first pulse sample, and no beats are looked for until its impulse response has
+// decayed below this fraction of its peak
+static const double BEAT_SETTLING_TOLERANCE = 0.01;
+// Spectral SNR in dB, from the power near the peak and its harmonic against the rest of the band, that maps to no
+// and to full confidence. Estimates below MIN_CONFIDENCE are not used
+static const double SNR_FLOOR_DB = 0.0;
+static const double SNR_CEILING_DB = 10.0;
+static const double MIN_CONFIDENCE = 0.3;
+// Windows where the face moved across more than this many face sizes, or the raw brightness varied by more than this
+// fraction of its mean, are not estimated from
+static const double MAX_WINDOW_MOTION = 0.3;
+static const double MAX_BRIGHTNESS_SPREAD = 0.02;
+// Rates below this are less likely and are down-weighted
+static const double LOW_HEART_RATE = 70;
+static const double LOW_HEART_RATE_WEIGHT = 0.6;
+
+static double bandWeight(double bpm)
 {
-	int numSamples = static_cast<int>(windowsRGB.size());
-	int numFeatures = 3;
-
-	MatrixXd X(numSamples, numFeatures);
-	for (int i = 0; i < numSamples; ++i) {
-		for (int j = 0; j < numFeatures; ++j) {
-			X(i, j) = windowsRGB[i][j];
-		}
+	if (bpm < MIN_HEART_RATE) {
+		return 0.0;
 	}
-
-	VectorXd Xc = 3 * X.col(0) - 2 * X.col(1);
-	VectorXd Yc = 1.5 * X.col(0) + X.col(1) - 1.5 * X.col(2);
-
-	double sX = sqrt((Xc.array() - Xc.mean()).square().sum() / (Xc.size() - 1));
-	double sY = sqrt((Yc.array() - Yc.mean()).square().sum() / (Yc.size() - 1));
-
-	VectorXd bvp = Xc - ((sX / sY) * Yc);
-
-	return vector<double_t>(bvp.data(), bvp.data() + bvp.size());
+	return bpm < LOW_HEART_RATE ? LOW_HEART_RATE_WEIGHT : 1.0;
 }
 
-void MovingAvg::updateWindows(vector<double_t> frameAvg)
+// Offset of the true peak from the highest bin, in bins, from a Gaussian through it and its neighbours. The main lobe
+// of a Hann window is close to Gaussian, so this is accurate to a small fraction of a bin
+static double peakOffset(double below, double peak, double above)
 {
-	if (windows.empty()) {
-		windows.push_back({frameAvg});
-		return;
+	if (below <= 0.0 || peak <= 0.0 || above <= 0.0) {
+		return 0.0;
 	}
-
-	Window last = windows.back();
-
-	if (static_cast<int>(last.size()) == windowSize) {
-		Window newWindow = Window(last.end() - windowStride, last.end());
-		newWindow.push_back(frameAvg);
-		if (static_cast<int>(windows.size()) == maxNumWindows) {
-			windows.erase(windows.begin());
-		}
-		windows.push_back(newWindow);
-	} else {
-		windows.back().push_back(frameAvg);
+	double logBelow = log(below), logPeak = log(peak), logAbove = log(above);
+	double curvature = 2.0 * logPeak - logBelow - logAbove;
+	if (curvature <= 0.0) {
+		return 0.0;
 	}
+	return clamp(0.5 * (logAbove - logBelow) / curvature, -0.5, 0.5);
 }
 
-FrameRGB extractRGB(std::shared_ptr<struct input_BGRA_data> bgraData)
+// Strongest peak of power[first..last] once weighted by the heart rate band, refined between bins. Only local maxima
+// of the unweighted power count, so the weighting ranks peaks without making new ones on their slopes. power[i] is
+// bin firstBin + i and must hold first - 1 and last + 1. Returns the rate in BPM, 0 if there is no peak
+static double strongestPeak(const double *power, int first, int last, int firstBin, double frequencyResolution)
 {
-	uint8_t *data = bgraData->data;
-	uint32_t width = bgraData->width;
-	uint32_t height = bgraData->height;
-	uint32_t linesize = bgraData->linesize;
-
-	FrameRGB frameRGB(height, vector<vector<uint8_t>>(width));
-
-	for (uint32_t y = 0; y < height; ++y) {
-		for (uint32_t x = 0; x < width; ++x) {
-			uint8_t B = data[y * linesize + x * 4];
-			uint8_t G = data[y * linesize + x * 4 + 1];
-			uint8_t R = data[y * linesize + x * 4 + 2];
-
-			frameRGB[y][x] = {R, G, B};
+	int maxIndex = -1;
+	double maxPower = 0.0;
+	for (int i = first; i <= last; ++i) {
+		if (power[i] < power[i - 1] || power[i] < power[i + 1]) {
+			continue;
+		}
+		double weighted = power[i] * bandWeight((firstBin + i) * frequencyResolution);
+		if (weighted > maxPower) {
+			maxPower = weighted;
+			maxIndex = i;
 		}
 	}
+	if (maxIndex < 0) {
+		return 0.0;
+	}
 
-	return frameRGB;
+	double offset = peakOffset(power[maxIndex - 1], power[maxIndex], power[maxIndex + 1]);
+	return (firstBin + maxIndex + offset) * frequencyResolution;
 }
 
-double MovingAvg::welch(vector<double_t> bvps)
+// Signal to noise ratio in dB of power[first..last] for a pulse at bpm: the bins within halfWidth bins of it and of its
+// first harmonic against the others. power[i] is bin firstBin + i
+static double bandSnr(const double *power, int first, int last, int firstBin, double frequencyResolution, double bpm,
+		      double halfWidth)
 {
+	double signal = 0.0, noise = 0.0;
+	for (int i = first; i <= last; ++i) {
+		double bin = firstBin + i;
+		double fundamental = bpm / frequencyResolution;
+		bool inPeak = abs(bin - fundamental) <= halfWidth || abs(bin - 2.0 * fundamental) <= halfWidth;
+		(inPeak ? signal : noise) += power[i];
+	}
+	if (signal <= 0.0) {
+		return -numeric_limits<double>::infinity();
+	}
+	return noise > 0.0 ? 10.0 * log10(signal / noise) : numeric_limits<double>::infinity();
+}
 
+double MovingAvg::welch(const Ref<const VectorXd> &bvps)
+{
 	using Eigen::ArrayXd;
 
 	int numFrames = static_cast<int>(bvps.size());
-	int nfft = 2048;
+	if (numFrames < 2) {
+		return 0.0;
+	}
 
 	// Define segment size and overlap
 	int segmentSize = 256;
 	int overlap = 200;
 
-	double frequencyResolution = (fps * 60.0) / numFrames;
-	int nyquistLimit = fps / 2;
+	// A single segment covers short signals
+	if (numFrames < segmentSize) {
+		segmentSize = numFrames;
+		overlap = 0;
+	}
+
+	// Zero-pad every segment to nfft, so the resolution does not depend on the segment length
+	int nfft = max(2048, nextPowerOfTwo(segmentSize));
+	double frequencyResolution = (fps * 60.0) / nfft;
+
+	std::shared_ptr<const FFTPlan> plan = FFTPlan::get(nfft);
+	std::shared_ptr<const vector<double>> window = hannWindow(segmentSize);
 
-	// Convert signal to Eigen array
-	ArrayXd signal = Eigen::Map<const ArrayXd>(bvps.data(), bvps.size());
+	welchSegment.resize(segmentSize);
+	welchPower.resize(nfft / 2 + 1);
 
 	// Divide signal into overlapping segments
 	int numSegments = 0;
-	ArrayXd psd = ArrayXd::Zero(nfft / 2 + 1);
+	ArrayXd &psd = welchPsd;
+	psd.setZero(nfft / 2 + 1);
 
-	if (numFrames < segmentSize) {
-		// Hann window
-		ArrayXd hannWindow(numFrames);
-		for (int i = 0; i < numFrames; ++i) {
-			hannWindow[i] = 0.5 * (1 - std::cos(2 * M_PI * i / (numFrames - 1)));
+	for (int start = 0; start + segmentSize <= numFrames; start += (segmentSize - overlap)) {
+		// Extract segment and apply window
+		for (int i = 0; i < segmentSize; ++i) {
+			welchSegment[i] = bvps(start + i) * (*window)[i];
 		}
 
-		ArrayXd windowedSignal = signal * hannWindow;
-		Eigen::ArrayXcd fft_result(numFrames);
-		for (int k = 0; k < numFrames; ++k) {
-			std::complex<double> sum(0.0, 0.0);
-			for (int n = 0; n < numFrames; ++n) {
-				double angle = -2.0 * M_PI * k * n / numFrames;
-				sum += windowedSignal[n] * std::exp(std::complex<double>(0, angle));
-			}
-			fft_result[k] = sum;
-		}
+		plan->powerSpectrum(welchSegment.data(), segmentSize, fftWork, welchPower.data());
+		psd += Eigen::Map<const ArrayXd>(welchPower.data(), welchPower.size()) / segmentSize;
 
-		// Compute power spectrum
-		ArrayXd powerSpectrum =
-			ArrayXd::Zero(numFrames / 2 + 1); // Only half the spectrum (0 to Nyquist frequency)
-		for (int k = 0; k <= numFrames / 2; ++k) {
-			psd[k] += std::norm(fft_result[k]) / numFrames;
+		++numSegments;
+	}
+
+	// Average PSD for this estimator
+	if (numSegments > 0) {
+		psd /= numSegments;
+	}
+
+	// Adjust Nyquist limit for human heart rates, leaving a bin above it to compare with
+	int nyquistLimitBPM = min(nfft / 2 - 1, static_cast<int>(MAX_HEART_RATE / frequencyResolution));
+
+	double heartRate = strongestPeak(psd.data(), 1, nyquistLimitBPM, 0, frequencyResolution);
+	// The peak's main lobe is two segment bins either side of it
+	double lobeBins = 2.0 * nfft / segmentSize;
+	int firstBandBin = static_cast<int>(ceil(MIN_HEART_RATE / frequencyResolution));
+	spectralSnr = bandSnr(psd.data(), firstBandBin, nyquistLimitBPM, 0, frequencyResolution, heartRate, lobeBins);
+	return heartRate;
+}
+
+// Same spectrum and segmentation as welch, but only the bins in the heart rate band are evaluated, each with
+// a Goertzel recurrence. The rest of the spectrum is never needed to pick the peak.
+double MovingAvg::goertzel(const Ref<const VectorXd> &bvps)
+{
+	int numFrames = static_cast<int>(bvps.size());
+	if (numFrames < 2) {
+		return 0.0;
+	}
+
+	int segmentSize = 256;
+	int overlap = 200;
+	if (numFrames < segmentSize) {
+		segmentSize = numFrames;
+		overlap = 0;
+	}
+	int nfft = max(2048, nextPowerOfTwo(segmentSize));
+	double frequencyResolution = (fps * 60.0) / nfft;
+
+	// Bins and recurrence coefficients only change with the sample rate
+	if (nfft != goertzelNfft || fps != goertzelFps) {
+		goertzelNfft = nfft;
+		goertzelFps = fps;
+		// One bin either side of the band, so peaks on its edges can be told from slopes
+		goertzelFirstBin = static_cast<int>(ceil(MIN_HEART_RATE / frequencyResolution)) - 1;
+		int lastBin = min(nfft / 2, static_cast<int>(MAX_HEART_RATE / frequencyResolution) + 1);
+		goertzelCoeffs.clear();
+		for (int k = goertzelFirstBin; k <= lastBin; ++k) {
+			goertzelCoeffs.push_back(2.0 * cos(2.0 * M_PI * k / nfft));
 		}
+	}
+	if (goertzelCoeffs.empty()) {
+		return 0.0;
+	}
 
-		++numSegments;
-	} else {
-		ArrayXd hannWindow(segmentSize);
+	std::shared_ptr<const vector<double>> window = hannWindow(segmentSize);
+	welchSegment.resize(segmentSize);
+	welchPower.assign(goertzelCoeffs.size(), 0.0);
+
+	int numSegments = 0;
+	for (int start = 0; start + segmentSize <= numFrames; start += (segmentSize - overlap)) {
 		for (int i = 0; i < segmentSize; ++i) {
-			hannWindow[i] = 0.5 * (1 - std::cos(2 * M_PI * i / (segmentSize - 1)));
+			welchSegment[i] = bvps(start + i) * (*window)[i];
 		}
 
-		for (int start = 0; start + segmentSize <= numFrames; start += (segmentSize - overlap)) {
-			// Extract segment and apply window
-			ArrayXd segment = signal.segment(start, segmentSize) * hannWindow;
-
-			Eigen::ArrayXcd fftResult(segmentSize);
-			for (int k = 0; k < segmentSize; ++k) {
-				std::complex<double> sum(0.0, 0.0);
-				for (int n = 0; n < segmentSize; ++n) {
-					double angle = -2.0 * M_PI * k * n / segmentSize;
-					sum += segment[n] * std::exp(std::complex<double>(0, angle));
-				}
-				fftResult[k] = sum;
+		for (size_t b = 0; b < goertzelCoeffs.size(); ++b) {
+			double coeff = goertzelCoeffs[b];
+			double s1 = 0.0, s2 = 0.0;
+			for (int i = 0; i < segmentSize; ++i) {
+				double s0 = welchSegment[i] + coeff * s1 - s2;
+				s2 = s1;
+				s1 = s0;
 			}
+			welchPower[b] += (s1 * s1 + s2 * s2 - coeff * s1 * s2) / segmentSize;
+		}
 
-			// Compute power spectrum
-			ArrayXd powerSpectrum =
-				ArrayXd::Zero(nyquistLimit + 1); // Only half the spectrum (0 to Nyquist frequency)
-			for (int k = 0; k <= nyquistLimit; ++k) {
-				psd[k] += std::norm(fftResult[k]) / segmentSize;
-			}
+		++numSegments;
+	}
+
+	// Averaging over segments does not move the peak, so the summed power is compared directly
+	int last = static_cast<int>(welchPower.size()) - 2;
+	double heartRate = strongestPeak(welchPower.data(), 1, last, goertzelFirstBin, frequencyResolution);
+	spectralSnr = bandSnr(welchPower.data(), 1, last, goertzelFirstBin, frequencyResolution, heartRate,
+			      2.0 * nfft / segmentSize);
+	return heartRate;
+}
+
+// Heart rate from the lag at which the pulse best matches itself, for signals too short for a useful spectrum
+double MovingAvg::autocorrelation(const Ref<const VectorXd> &bvps, double &correlation)
+{
+	correlation = 0.0;
+	int minLag = max(1, static_cast<int>(floor(fps * 60.0 / MAX_HEART_RATE)));
+	int maxLag = static_cast<int>(ceil(fps * 60.0 / MIN_HEART_RATE));
+	int numFrames = static_cast<int>(bvps.size());
+	if (numFrames <= maxLag + 1) {
+		return 0.0;
+	}
 
-			++numSegments;
+	double mean = bvps.mean();
+	autocorrelations.assign(maxLag + 2, 0.0);
+	double best = 0.0;
+	for (int lag = minLag - 1; lag <= maxLag + 1; ++lag) {
+		Index overlap = numFrames - lag;
+		auto head = bvps.head(overlap).array() - mean;
+		auto tail = bvps.tail(overlap).array() - mean;
+		double energy = sqrt(head.square().sum() * tail.square().sum());
+		autocorrelations[lag] = energy > 0.0 ? (head * tail).sum() / energy : 0.0;
+		if (lag >= minLag && lag <= maxLag) {
+			best = max(best, autocorrelations[lag]);
 		}
 	}
+	if (best <= 0.0) {
+		return 0.0;
+	}
 
-	// Average PSD for this estimator
-	if (numSegments > 0) {
-		psd /= numSegments;
+	// The shortest lag that is a local maximum close to the strongest, refined by a parabola through its neighbours
+	for (int lag = minLag; lag <= maxLag; ++lag) {
+		double below = autocorrelations[lag - 1];
+		double peak = autocorrelations[lag];
+		double above = autocorrelations[lag + 1];
+		if (peak < below || peak < above || peak < AUTOCORRELATION_PEAK_RATIO * best) {
+			continue;
+		}
+		double curvature = below - 2.0 * peak + above;
+		double offset = curvature < 0.0 ? clamp(0.5 * (below - above) / curvature, -0.5, 0.5) : 0.0;
+		correlation = peak;
+		return fps * 60.0 / (lag + offset);
 	}
+	return 0.0;
+}
 
-	// Adjust Nyquist limit for human heart rates
-	int nyquistLimitBPM = min(min(numFrames / 2, nyquistLimit), static_cast<int>(200 / frequencyResolution));
+void MovingAvg::resetSignal(int preFilter, int ppg)
+{
+	int capacity = maxNumWindows * windowSize;
+	signal.reset(capacity);
+	pipelineData.reserve(capacity, BANDPASS_ORDER);
+	latestPpg.reserve(capacity);
+	samplesSinceEstimate = 0;
+	provisional = false;
+	provisionalIndex = 0;
+	windowBrightness = windowBrightnessSquares = 0.0;
+	windowHasFace = false;
+	beats.reset(fps);
+	beatFilter = SosFilter(bandpassSections(fps), 1);
+	beatPulse.assign(capacity, 0.0);
+	beatPulseEnd = 0;
+	beatSamples = 0;
+	beatWindows.clear();
+	beatWindows.reserve(4 * maxNumWindows);
+	beatWindows.push_back({static_cast<uint64_t>(beatFilter.settlingSamples(BEAT_SETTLING_TOLERANCE)), false});
+	tracker.reset();
+	currentPreFilter = preFilter;
+	currentPpg = ppg;
+	streamedPulse = ppgStreamsPulse(ppg);
+	lastAvg.clear();
+
+	pos.reset(static_cast<int>(lround(POS_WINDOW_SECONDS * fps)), capacity);
+
+	// POS normalises each window by its own mean, so it takes the colours before any pre-filter
+	preFilterStream = createPreFilterStream(preFilter, ppg, fps, capacity);
+}
 
-	double lowerLimit = 55;
-	double threshold = 70;
-	double sf = 0.6;
-	for (int k = 0; k <= nyquistLimitBPM; ++k) {
-		if (k * frequencyResolution < lowerLimit) {
-			psd[k] = 0;
-		}
-		if (k * frequencyResolution < threshold) {
-			psd[k] *= sf;
+// Resamples frame means onto an even grid at fps as they arrive, so the spectrum reflects the times they were taken
+// at. Means that do not move forward in time are ignored, and a gap longer than the buffer starts again
+void MovingAvg::addSample(const vector<double_t> &avg, double time)
+{
+	if (avg.size() < 3 || (!lastAvg.empty() && time <= lastTime)) {
+		return;
+	}
+	if (!lastAvg.empty() && time - lastTime > maxNumWindows) {
+		resetSignal(currentPreFilter, currentPpg);
+	}
+	if (lastAvg.empty()) {
+		lastAvg = avg;
+		lastTime = time;
+		gridStart = time;
+		gridIndex = 0;
+
+		double first[3] = {avg[0], avg[1], avg[2]};
+		if (preFilterStream) {
+			preFilterStream->settle(first);
 		}
 	}
 
-	int maxIndex;
-	psd.head(nyquistLimitBPM + 1).maxCoeff(&maxIndex);
-	double dominantFrequency = maxIndex * frequencyResolution;
+	double rgb[3];
+	for (double t = gridStart + gridIndex / double(fps); t <= time; t = gridStart + ++gridIndex / double(fps)) {
+		double weight = time > lastTime ? (t - lastTime) / (time - lastTime) : 1.0;
+		for (int c = 0; c < 3; ++c) {
+			rgb[c] = lastAvg[c] + weight * (avg[c] - lastAvg[c]);
+		}
+		pushGridSample(rgb, t);
+	}
 
-	return dominantFrequency;
+	lastAvg = avg;
+	lastTime = time;
 }
 
-Window concatWindows(Windows windows)
+void MovingAvg::pushGridSample(double *rgb, double time)
 {
-	Window concatenatedWindow;
+	double brightness = rgb[0] + rgb[1] + rgb[2];
+	windowBrightness += brightness;
+	windowBrightnessSquares += brightness * brightness;
+
+	pos.push(rgb);
+	pushBeatSample();
+	if (preFilterStream) {
+		preFilterStream->process(rgb, time);
+	}
+	signal.push(rgb, time);
+	samplesSinceEstimate++;
+}
 
-	for (const auto &window : windows) {
-		for (const auto &sig : window) {
-			concatenatedWindow.push_back(sig);
-		}
+// Runs the selected stages over the buffered samples
+PipelineData::PulseView MovingAvg::extractPulse()
+{
+	pipelineData.colours = preFilterStream ? &preFilterStream->colours(signal) : &signal;
+	pipelineData.pos = &pos;
+	pipelineData.fps = fps;
+	if (pipeline) {
+		pipeline(pipelineData);
+	} else {
+		pipelineData.resize(0);
 	}
+	return pipelineData.ppg();
+}
 
-	return concatenatedWindow;
+// Band-passes the POS sample made final by the latest grid sample, if there is one
+void MovingAvg::pushBeatSample()
+{
+	if (gridIndex < static_cast<uint64_t>(pos.latency())) {
+		return;
+	}
+	double sample = pos.pulse(1)(0);
+	if (beatPulseEnd == 0) {
+		beatFilter.settle(&sample);
+	}
+	beatFilter.process(&sample);
+	beatPulse[beatPulseEnd % beatPulse.size()] = sample;
+	beatPulseEnd++;
+
+	// Samples still waiting when the ring wraps are passed over rather than overwritten
+	if (beatPulseEnd - beatSamples > beatPulse.size()) {
+		beats.skip(1);
+		beatSamples++;
+	}
 }
 
-double MovingAvg::smoothHeartRate(double hr)
+// Judges the grid samples since the last call as estimated from or not, then passes every band-passed sample whose
+// window is judged to the beat detector, or skips it. Each sample is taken once, so beats and their intervals do not
+// depend on where the windows end
+void MovingAvg::detectBeats(bool estimated)
 {
-	double meanHr = accumulate(heartRates.begin(), heartRates.end(), 0.0) / heartRates.size();
+	beatWindows.push_back({gridIndex, estimated});
+	while (!beatWindows.empty()) {
+		const BeatWindow &window = beatWindows.front();
+		uint64_t end = min(window.end, beatPulseEnd);
+		if (beatSamples < end && window.estimated) {
+			for (; beatSamples < end; ++beatSamples) {
+				beats.push(beatPulse[beatSamples % beatPulse.size()]);
+			}
+		} else if (beatSamples < end) {
+			beats.skip(end - beatSamples);
+			beatSamples = end;
+		}
+		if (beatSamples < window.end) {
+			return;
+		}
+		beatWindows.erase(beatWindows.begin());
+	}
+}
 
-	double offset = 20.0;
+// Until the first full estimate, a rough rate from the autocorrelation of the latest samples every half second
+double MovingAvg::provisionalHeartRate()
+{
+	if (signal.size() < PROVISIONAL_SECONDS * windowSize) {
+		return -1.0;
+	}
+	if (provisionalIndex > 0 && gridIndex - provisionalIndex < static_cast<uint64_t>(uiUpdateInterval)) {
+		return provisional ? provisionalRate : -1.0;
+	}
+	provisionalIndex = gridIndex;
+
+	// Drift over so short a window would otherwise outweigh the pulse
+	PipelineData::PulseView ppgSignal = extractPulse();
+	detrendSignal(ppgSignal);
+	double correlation;
+	double heartRate = autocorrelation(ppgSignal, correlation);
+	if (!streamedPulse) {
+		latestPpg.assign(ppgSignal.data(), ppgSignal.data() + ppgSignal.size());
+	}
+	beats.setExpectedInterval(heartRate > 0.0 ? 60.0 / heartRate : 0.0);
+	detectBeats(true);
 
-	heartRates.erase(heartRates.begin());
+	if (heartRate <= 0.0) {
+		return provisional ? provisionalRate : -1.0;
+	}
+	provisional = true;
+	provisionalRate = heartRate;
+	confidence = clamp(correlation, 0.0, 1.0);
+	return provisionalRate;
+}
 
-	if (hr != 0) {
-		heartRates.push_back(hr);
+void MovingAvg::addFacePosition(double x, double y)
+{
+	double position[2] = {x, y};
+	for (int i = 0; i < 2; ++i) {
+		windowFaceMin[i] = windowHasFace ? min(windowFaceMin[i], position[i]) : position[i];
+		windowFaceMax[i] = windowHasFace ? max(windowFaceMax[i], position[i]) : position[i];
 	}
+	windowHasFace = true;
+}
 
-	if (hr > meanHr + offset) {
-		return meanHr + offset;
-	} else if (hr < meanHr - offset) {
-		return meanHr - offset;
+// Whether the face kept still and the light steady over the numSamples since the last estimate, then starts
+// gathering for the next window. Movement is the extent of the face positions, so detection jitter does not add up
+bool MovingAvg::windowIsSteady(int numSamples)
+{
+	double motion = 0.0;
+	if (windowHasFace) {
+		motion = max(windowFaceMax[0] - windowFaceMin[0], windowFaceMax[1] - windowFaceMin[1]);
 	}
+	double mean = windowBrightness / numSamples;
+	double variance = max(windowBrightnessSquares / numSamples - mean * mean, 0.0);
+	bool steady = motion <= MAX_WINDOW_MOTION && (mean <= 0.0 || sqrt(variance) <= MAX_BRIGHTNESS_SPREAD * mean);
 
-	return hr;
+	windowBrightness = windowBrightnessSquares = 0.0;
+	windowHasFace = false;
+	return steady;
+}
+
+// Heart rate shown while an estimate is skipped
+double MovingAvg::heldHeartRate() const
+{
+	if (uiHeartRate == -1.0 && provisional) {
+		return provisionalRate;
+	}
+	return uiHeartRate;
 }
 
-double MovingAvg::calculateHeartRate(vector<double_t> avg, int preFilter, int ppg, int postFilter, bool smooth, int Fps,
-				     int sampleRate)
+double MovingAvg::calculateHeartRate(const vector<double_t> &avg, int preFilter, int ppg, int postFilter, bool smooth,
+				     int Fps, int sampleRate, double timestamp, int spectralEstimator)
 {
 	uint64_t start_heart_rate;
 	if (enableTiming) {
@@ -302,90 +554,79 @@ double MovingAvg::calculateHeartRate(vector<double_t> avg, int preFilter, int pp
 	windowSize = sampleRate * fps;
 	uiUpdateInterval = fps / 2;
 
-	updateWindows(avg);
+	// Holds maxNumWindows seconds, and starts again if the sample rate, pre-filter or PPG algorithm changes
+	bool reset = signal.capacity() != maxNumWindows * windowSize || preFilter != currentPreFilter ||
+		     ppg != currentPpg;
+	if (reset) {
+		resetSignal(preFilter, ppg);
+	}
+	// The stages are chosen once here rather than for every estimate
+	if (reset || postFilter != currentPostFilter) {
+		pipeline = selectPipeline(preFilter, ppg, postFilter);
+		currentPostFilter = postFilter;
+	}
 
-	vector<double_t> ppgSignal;
+	// Without a timestamp assume the samples are evenly spaced at Fps
+	if (timestamp < 0.0) {
+		timestamp = static_cast<double>(numSamples) / fps;
+	}
+	numSamples++;
 
-	if (!windows.empty() && static_cast<int>(windows.back().size()) == windowSize &&
-	    static_cast<int>(windows.size()) >= calibrationTime) {
-		Window currentWindow = concatWindows(windows);
+	addSample(avg, timestamp);
 
-		uint64_t start_pre_filter, end_pre_filter;
-		if (enableTiming) {
-			start_pre_filter = os_gettime_ns();
-		}
-		Window filteredWindow = applyPreFilter(currentWindow, preFilter, fps);
-		if (enableTiming) {
-			end_pre_filter = os_gettime_ns();
-			obs_log(LOG_INFO, "Pre-filtering took: %lu ns", end_pre_filter - start_pre_filter);
-		}
+	// The smoothed rate follows its trend between estimates
+	if (smooth && tracker.tracking()) {
+		tracker.predict(clamp(timestamp - trackerTime, 0.0, static_cast<double>(maxNumWindows)));
+		uiHeartRate = tracker.rate();
+	}
+	trackerTime = timestamp;
 
-		uint64_t start_ppg, end_ppg;
-		if (enableTiming) {
-			start_ppg = os_gettime_ns();
-		}
-		switch (ppg) {
-		case 0:
-			ppgSignal = green(filteredWindow);
-			break;
-		case 1:
-			ppgSignal = pca(filteredWindow);
-			break;
-		case 2:
-			ppgSignal = chrom(filteredWindow);
-			break;
-		default:
-			break;
-		}
-		if (enableTiming) {
-			end_ppg = os_gettime_ns();
-			obs_log(LOG_INFO, "PPG calculation took: %lu ns", end_ppg - start_ppg);
-		}
+	// The POS pulse grows with every grid sample, not just once per estimate
+	if (streamedPulse) {
+		PosStream::PulseView pulse = pos.pulse(pos.size());
+		latestPpg.assign(pulse.data(), pulse.data() + pulse.size());
+	}
 
-		uint64_t start_post_filter, end_post_filter;
-		if (enableTiming) {
-			start_post_filter = os_gettime_ns();
-		}
-		vector<double_t> filtered_ppg = applyPostFilter(ppgSignal, postFilter, fps);
-		if (enableTiming) {
-			end_post_filter = os_gettime_ns();
-			obs_log(LOG_INFO, "Post-filtering took: %lu ns", end_post_filter - start_post_filter);
+	if (samplesSinceEstimate >= windowSize && signal.size() >= calibrationTime * windowSize) {
+		int newSamples = samplesSinceEstimate;
+		samplesSinceEstimate = 0;
+
+		// Windows where the face moved or the light changed are not worth estimating from
+		if (!windowIsSteady(newSamples)) {
+			confidence = 0.0;
+			detectBeats(false);
+			return heldHeartRate();
 		}
+		PipelineData::PulseView ppgSignal = extractPulse();
 
 		uint64_t start_welch, end_welch;
 		if (enableTiming) {
 			start_welch = os_gettime_ns();
 		}
-		double heartRate = welch(filtered_ppg);
+		double heartRate = spectralEstimator == 1 ? goertzel(ppgSignal) : welch(ppgSignal);
 		if (enableTiming) {
 			end_welch = os_gettime_ns();
-			obs_log(LOG_INFO, "Welch took: %lu ns", end_welch - start_welch);
+			obs_log(LOG_INFO, "Spectral estimation took: %lu ns", end_welch - start_welch);
+		}
+		if (!streamedPulse) {
+			latestPpg.assign(ppgSignal.data(), ppgSignal.data() + ppgSignal.size());
 		}
 
-		if (smooth) {
-			uint64_t start_smooth, end_smooth;
-			if (enableTiming) {
-				start_smooth = os_gettime_ns();
-			}
-			if (static_cast<int>(heartRates.size()) < numHeartRates) {
-				heartRates.push_back(heartRate);
-			} else {
-				heartRate = smoothHeartRate(heartRate);
-			}
-			if (enableTiming) {
-				end_smooth = os_gettime_ns();
-				obs_log(LOG_INFO, "Smoothing took: %lu ns", end_smooth - start_smooth);
-			}
+		// Estimates buried in noise are dropped before they reach the smoothing
+		confidence = clamp((spectralSnr - SNR_FLOOR_DB) / (SNR_CEILING_DB - SNR_FLOOR_DB), 0.0, 1.0);
+		if (confidence < MIN_CONFIDENCE) {
+			detectBeats(false);
+			return heldHeartRate();
 		}
+		provisional = false;
+		beats.setExpectedInterval(heartRate > 0.0 ? 60.0 / heartRate : 0.0);
+		detectBeats(true);
 
-		if (uiHeartRate == -1.0) {
-			uiHeartRate = heartRate;
-			prevHr = heartRate;
+		if (smooth) {
+			tracker.update(heartRate, confidence);
+			uiHeartRate = tracker.rate();
 		} else {
-			if (heartRates.size() >= 2 && heartRates[heartRates.size() - 2] - heartRate <= 30) {
-				uiUpdateAmount = min((heartRate - uiHeartRate) / NUM_UPDATES, 5.0);
-				prevHr = heartRate;
-			}
+			uiHeartRate = heartRate;
 		}
 
 		if (enableTiming) {
@@ -396,14 +637,9 @@ double MovingAvg::calculateHeartRate(vector<double_t> avg, int preFilter, int pp
 		return uiHeartRate;
 
 	} else {
-		if (static_cast<int>(windows.size()) < calibrationTime) {
-			return -1.0;
-		}
-
-		framesSincePPG += 1;
-
-		if (!heartRates.empty() && framesSincePPG % uiUpdateInterval == 0 && uiHeartRate != prevHr) {
-			uiHeartRate += uiUpdateAmount;
+		// Provisional estimates carry on until a full one is accepted
+		if (signal.size() < calibrationTime * windowSize || uiHeartRate == -1.0) {
+			return provisionalHeartRate();
 		}
 
 		if (enableTiming) {
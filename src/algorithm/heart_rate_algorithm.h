@@ -14,44 +14,140 @@
 #include <complex>
 #include <algorithm>
 #include <cstdlib>
+#include <memory>
 #include <ctime>
 #include "heart_rate_source.h"
-#include <numeric>
+#include "signal_buffer.h"
+#include "pos.h"
+#include "beat_detector.h"
+#include "heart_rate_tracker.h"
+#include "pipeline.h"
+#include "filtering/sos_filter.h"
 
 class MovingAvg {
 private:
-	int windowSize;
-	int windowStride = 1;
-	int maxNumWindows = 8;
-	int calibrationTime = 5;
+	int windowSize; // Samples in one second, the heart rate is estimated once per window
+	// Peaks are refined between bins, so short windows stay precise and the first estimate comes after
+	// calibrationTime windows
+	int maxNumWindows = 6;
+	int calibrationTime = 4;
 	int fps;
 
-	std::vector<std::vector<std::vector<double_t>>> windows;
+	// Last maxNumWindows windows of R, G, B means on an even grid at fps, through the pre-filter's stream if any
+	SignalBuffer signal;
+	uint64_t numSamples = 0;
+	int samplesSinceEstimate = 0;
+	int currentPreFilter = -1;
+	int currentPpg = -1;
+	bool streamedPulse = false; // Whether the current PPG estimates from the POS pulse rather than the colours
+	int currentPostFilter = -1;
+
+	// Last frame mean, which grid samples up to the next frame are interpolated from
+	std::vector<double_t> lastAvg;
+	double lastTime = 0.0;
+	double gridStart = 0.0;
+	uint64_t gridIndex = 0;
+
+	// State of the selected pre-filter if it filters the samples as they arrive
+	std::unique_ptr<PreFilterStream> preFilterStream;
+
+	// POS pulse, built from the raw colours one grid sample at a time. It is estimated from if POS is selected, and
+	// beats are found in it whatever is selected
+	PosStream pos;
+
+	// Pre-filter, PPG and post-filter stages for the current settings, and their buffers, reused so estimating
+	// allocates nothing once warmed up
+	PipelineFn pipeline = nullptr;
+	PipelineData pipelineData;
 
 	std::vector<std::vector<bool>> latestSkinKey;
 	bool detectFace = false;
 
-	std::vector<double_t> heartRates;
-	int numHeartRates = 8;
+	std::vector<double_t> latestPpg;
 
-	double uiHeartRate = -1.0;
-	int uiUpdateInterval;
-	double uiUpdateAmount = 0.0;
-	int framesSincePPG = 0;
-	int NUM_UPDATES = 10;
-	double prevHr;
+	// Beats found in the POS pulse, band-passed once as each sample is final. The samples wait in beatPulse, at
+	// their grid index modulo its size, until the windows they fall in are judged. beatPulseEnd counts the samples
+	// band-passed since the last reset and beatSamples those taken or skipped
+	BeatDetector beats;
+	SosFilter beatFilter;
+	std::vector<double_t> beatPulse;
+	uint64_t beatPulseEnd = 0;
+	uint64_t beatSamples = 0;
+
+	// Windows judged whose samples are not all taken or skipped yet, with the grid index each ends before
+	struct BeatWindow {
+		uint64_t end;
+		bool estimated;
+	};
+	std::vector<BeatWindow> beatWindows;
 
-	std::vector<double_t> averageRGB(std::vector<std::vector<std::vector<uint8_t>>> rgb,
-					 std::vector<std::vector<bool>> skinKey = {});
+	// Welch scratch buffers, reused between estimates
+	std::vector<double_t> welchSegment;
+	std::vector<double_t> welchPower;
+	Eigen::ArrayXd welchPsd;
+	std::vector<std::complex<double>> fftWork;
+
+	// Goertzel recurrence coefficient of every heart rate band bin, from goertzelFirstBin
+	std::vector<double_t> goertzelCoeffs;
+	int goertzelFirstBin = 0;
+	int goertzelNfft = 0;
+	int goertzelFps = 0;
+
+	// Rough estimate published while calibrating, until the first full one
+	bool provisional = false;
+	double provisionalRate = -1.0;
+	uint64_t provisionalIndex = 0;
+	std::vector<double_t> autocorrelations;
+
+	// Quality of the latest estimate from 0 to 1, -1 before the first. Gathered per window: the in-band SNR of the
+	// spectrum, the spread of the raw brightness and the extent of the face positions
+	double confidence = -1.0;
+	double spectralSnr = 0.0;
+	double windowBrightness = 0.0;
+	double windowBrightnessSquares = 0.0;
+	bool windowHasFace = false;
+	double windowFaceMin[2] = {0.0, 0.0};
+	double windowFaceMax[2] = {0.0, 0.0};
+
+	// Smoothed heart rate, moved forward every frame and corrected by every accepted estimate
+	HeartRateTracker tracker;
+	double trackerTime = 0.0;
+
+	double uiHeartRate = -1.0; // Heart rate returned, -1 until an estimate is accepted
+	int uiUpdateInterval;
 
-	void updateWindows(std::vector<double_t> frameAvg);
+	std::vector<double_t> averageRGB(const std::vector<std::vector<std::vector<uint8_t>>> &rgb,
+					 const std::vector<std::vector<bool>> &skinKey = {});
 
-	double welch(std::vector<double_t> ppgSignal);
+	void resetSignal(int preFilter, int ppg);
+	void addSample(const std::vector<double_t> &avg, double time);
+	void pushGridSample(double *rgb, double time);
+	PipelineData::PulseView extractPulse();
+	double provisionalHeartRate();
+	bool windowIsSteady(int numSamples);
+	double heldHeartRate() const;
+	void pushBeatSample();
+	void detectBeats(bool estimated);
 
-	double smoothHeartRate(double hr);
+	double welch(const Eigen::Ref<const Eigen::VectorXd> &ppgSignal);
+	double goertzel(const Eigen::Ref<const Eigen::VectorXd> &ppgSignal);
+	double autocorrelation(const Eigen::Ref<const Eigen::VectorXd> &ppgSignal, double &correlation);
 
 public:
-	double calculateHeartRate(std::vector<double_t> avg, int preFilter = 1, int ppgAlgorithm = 1,
-				  int postFilter = 0, bool smooth = true, int Fps = 30, int sampleRate = 1);
+	// avg is the R, G, B skin mean of one frame
+	double calculateHeartRate(const std::vector<double_t> &avg, int preFilter = 1, int ppgAlgorithm = 1,
+				  int postFilter = 0, bool smooth = true, int Fps = 30, int sampleRate = 1,
+				  double timestamp = -1.0, int spectralEstimator = 0);
+	// Pulse signal the last heart rate was estimated from
+	const std::vector<double_t> &getLatestPpg() const { return latestPpg; }
+	// Heart rate variability from the beats found so far
+	HrvStats getHrv() const { return beats.stats(); }
+	// Whether the last heart rate is a provisional estimate made while calibrating
+	bool isProvisional() const { return provisional; }
+	// Quality of the last heart rate from 0 to 1, -1 if none was estimated yet. Provisional estimates give the
+	// autocorrelation at their period
+	double getConfidence() const { return confidence; }
+	// Centre of the face in the latest frame, in face widths and heights
+	void addFacePosition(double x, double y);
 };
 #endif
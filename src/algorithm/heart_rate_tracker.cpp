@@ -0,0 +1,61 @@
+#include "heart_rate_tracker.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace Eigen;
+
+// Spread of a full confidence estimate about the true rate, in BPM. Less confident ones are trusted less, down to
+// MIN_CONFIDENCE
+static const double MEASUREMENT_SD = 3.0;
+static const double MIN_CONFIDENCE = 0.05;
+// How fast the trend itself may change, in BPM per second per square root second, and how long it lasts, in seconds
+static const double TREND_NOISE = 0.5;
+static const double TREND_SECONDS = 5.0;
+// Spread of the trend when a track starts, in BPM per second
+static const double INITIAL_TREND_SD = 1.0;
+// Estimates further than this many standard deviations from the track are trusted less the further they are
+static const double GATE_SIGMAS = 3.0;
+
+void HeartRateTracker::predict(double seconds)
+{
+	if (!initialised || seconds <= 0.0) {
+		return;
+	}
+
+	// The trend decays towards zero, so it is not carried on indefinitely while no estimates arrive
+	double decay = std::exp(-seconds / TREND_SECONDS);
+	Matrix2d transition;
+	transition << 1.0, TREND_SECONDS * (1.0 - decay), 0.0, decay;
+
+	double q = TREND_NOISE * TREND_NOISE;
+	Matrix2d noise;
+	noise << q * seconds * seconds * seconds / 3.0, q * seconds * seconds / 2.0, q * seconds * seconds / 2.0,
+		q * seconds;
+
+	state = transition * state;
+	covariance = transition * covariance * transition.transpose() + noise;
+}
+
+void HeartRateTracker::update(double bpm, double confidence)
+{
+	double variance = MEASUREMENT_SD * MEASUREMENT_SD / std::max(confidence, MIN_CONFIDENCE);
+	if (!initialised) {
+		state << bpm, 0.0;
+		covariance << variance, 0.0, 0.0, INITIAL_TREND_SD * INITIAL_TREND_SD;
+		initialised = true;
+		return;
+	}
+
+	double innovation = bpm - state(0);
+	double spread = covariance(0, 0) + variance;
+	double gate = GATE_SIGMAS * GATE_SIGMAS * spread;
+	if (innovation * innovation > gate) {
+		variance *= innovation * innovation / gate;
+		spread = covariance(0, 0) + variance;
+	}
+
+	Vector2d gain = covariance.col(0) / spread;
+	state += gain * innovation;
+	covariance -= gain * covariance.row(0);
+}
@@ -0,0 +1,28 @@
+#ifndef HEART_RATE_TRACKER_H
+#define HEART_RATE_TRACKER_H
+
+#include <Eigen/Dense>
+
+// Kalman filter over the heart rate and its trend. Estimates are fused in as they arrive, trusted in proportion to
+// their confidence and less the further they fall from the track, and the rate can be read at any time in between.
+// Every step is constant time and nothing is allocated.
+class HeartRateTracker {
+public:
+	// Forgets the track, the next estimate starts a new one
+	void reset() { initialised = false; }
+	bool tracking() const { return initialised; }
+
+	// Moves the track seconds forward
+	void predict(double seconds);
+	// Fuses in an estimate in BPM with a confidence from 0 to 1
+	void update(double bpm, double confidence);
+
+	double rate() const { return state(0); }
+
+private:
+	bool initialised = false;
+	Eigen::Vector2d state = Eigen::Vector2d::Zero(); // BPM, and BPM per second
+	Eigen::Matrix2d covariance = Eigen::Matrix2d::Zero();
+};
+
+#endif
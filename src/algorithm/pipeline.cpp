@@ -0,0 +1,137 @@
+#include "pipeline.h"
+#include "ppg.h"
+#include "plugin-support.h"
+#include "heart_rate_source.h"
+#include "filtering/pre_filters.h"
+#include "filtering/post_filters.h"
+#include "filtering/filter_util.h"
+
+#include <obs-module.h>
+#include <util/platform.h>
+#include <vector>
+
+using namespace std;
+
+void PipelineData::reserve(int maxSamples, int maxSections)
+{
+	resize(maxSamples);
+	size_t filterSize = sosScratchSize(maxSamples, maxSections);
+	if (filterScratch.size() < filterSize) {
+		filterScratch.resize(filterSize);
+	}
+}
+
+void PipelineData::resize(int samples)
+{
+	size_t needed = static_cast<size_t>(max(samples, 0));
+	if (ppgStorage.size() < needed) {
+		rgbStorage.resize(needed * 3);
+		ppgStorage.resize(needed);
+		scratchStorage.resize(needed);
+	}
+	numSamples = static_cast<int>(needed);
+}
+
+// Stages selectable in the properties, in the order of their setting values. A new stage is added by writing it next
+// to the others and listing it here
+template<class... Stages> struct StageList {
+	static constexpr int SIZE = sizeof...(Stages);
+};
+
+using PreFilterStages = StageList<NoPreFilter, StreamedBandpassPreFilter, DetrendPreFilter, ZeroMeanPreFilter,
+				  ZeroPhaseBandpassPreFilter>;
+using PpgStages = StageList<GreenPpg, PcaPpg, ChromPpg, PosPpg>;
+using PostFilterStages = StageList<NoPostFilter, BandpassPostFilter>;
+
+static void logStage(const char *stage, uint64_t &start)
+{
+	if (enableTiming) {
+		uint64_t end = os_gettime_ns();
+		obs_log(LOG_INFO, "%s took: %lu ns", stage, end - start);
+		start = end;
+	}
+}
+
+template<class PreFilter, class Ppg, class PostFilter> static void runPipeline(PipelineData &data)
+{
+	uint64_t start = enableTiming ? os_gettime_ns() : 0;
+
+	if constexpr (Ppg::USES_COLOURS) {
+		data.resize(data.colours->size());
+		data.rgb() = data.colours->colours(data.colours->size());
+		PreFilter::apply(data);
+		logStage("Pre-filtering", start);
+	}
+
+	Ppg::template apply<PreFilter>(data);
+	logStage("PPG calculation", start);
+
+	PostFilter::apply(data);
+	logStage("Post-filtering", start);
+}
+
+// Instantiates every combination, with the post-filter varying fastest
+template<class PreFilter, class Ppg, class... PostFilters>
+static void addPostFilters(vector<PipelineFn> &pipelines, StageList<PostFilters...>)
+{
+	(pipelines.push_back(runPipeline<PreFilter, Ppg, PostFilters>), ...);
+}
+
+template<class PreFilter, class... Ppgs> static void addPpgs(vector<PipelineFn> &pipelines, StageList<Ppgs...>)
+{
+	(addPostFilters<PreFilter, Ppgs>(pipelines, PostFilterStages()), ...);
+}
+
+template<class... PreFilters> static void addPreFilters(vector<PipelineFn> &pipelines, StageList<PreFilters...>)
+{
+	(addPpgs<PreFilters>(pipelines, PpgStages()), ...);
+}
+
+PipelineFn selectPipeline(int preFilter, int ppg, int postFilter)
+{
+	static const vector<PipelineFn> pipelines = [] {
+		vector<PipelineFn> all;
+		addPreFilters(all, PreFilterStages());
+		return all;
+	}();
+
+	if (preFilter < 0 || preFilter >= PreFilterStages::SIZE || ppg < 0 || ppg >= PpgStages::SIZE ||
+	    postFilter < 0 || postFilter >= PostFilterStages::SIZE) {
+		return nullptr;
+	}
+	return pipelines[(preFilter * PpgStages::SIZE + ppg) * PostFilterStages::SIZE + postFilter];
+}
+
+template<class... PreFilters>
+static unique_ptr<PreFilterStream> createStream(int preFilter, int fps, int capacity, StageList<PreFilters...>)
+{
+	typedef unique_ptr<PreFilterStream> (*StreamFactory)(int fps, int capacity);
+	static const StreamFactory factories[] = {PreFilters::createStream...};
+	return factories[preFilter](fps, capacity);
+}
+
+template<class... Ppgs> static bool usesColours(int ppg, StageList<Ppgs...>)
+{
+	static const bool uses[] = {Ppgs::USES_COLOURS...};
+	return uses[ppg];
+}
+
+template<class... Ppgs> static bool streamsPulse(int ppg, StageList<Ppgs...>)
+{
+	static const bool streams[] = {Ppgs::STREAMS_PULSE...};
+	return streams[ppg];
+}
+
+bool ppgStreamsPulse(int ppg)
+{
+	return ppg >= 0 && ppg < PpgStages::SIZE && streamsPulse(ppg, PpgStages());
+}
+
+unique_ptr<PreFilterStream> createPreFilterStream(int preFilter, int ppg, int fps, int capacity)
+{
+	if (preFilter < 0 || preFilter >= PreFilterStages::SIZE || ppg < 0 || ppg >= PpgStages::SIZE ||
+	    !usesColours(ppg, PpgStages())) {
+		return nullptr;
+	}
+	return createStream(preFilter, fps, capacity, PreFilterStages());
+}
@@ -0,0 +1,67 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "signal_buffer.h"
+#include "pos.h"
+
+#include <Eigen/Dense>
+#include <memory>
+#include <vector>
+
+// What the stages of one estimate read and write. Stages work on views of buffers reserved for the largest window,
+// so once reserved an estimate allocates nothing.
+struct PipelineData {
+	using ColourView = Eigen::Map<Eigen::Matrix<double, Eigen::Dynamic, 3>>;
+	using PulseView = Eigen::Map<Eigen::VectorXd>;
+
+	const SignalBuffer *colours = nullptr; // After any pre-filter stream
+	const PosStream *pos = nullptr;
+	int fps = 0;
+
+	// Makes room for windows of up to maxSamples, filtered by cascades of up to maxSections
+	void reserve(int maxSamples, int maxSections);
+	// Sets how many samples the views cover
+	void resize(int samples);
+	int size() const { return numSamples; }
+
+	// One row per sample with R, G, B columns, pre-filtered in place
+	ColourView rgb() { return ColourView(rgbStorage.data(), numSamples, 3); }
+	PulseView ppg() { return PulseView(ppgStorage.data(), numSamples); }
+	// Pulse-sized space for stages to work in
+	PulseView scratch() { return PulseView(scratchStorage.data(), numSamples); }
+
+	std::vector<double> filterScratch; // For sosFilterColumns
+
+private:
+	int numSamples = 0;
+	std::vector<double> rgbStorage;
+	std::vector<double> ppgStorage;
+	std::vector<double> scratchStorage;
+};
+
+// State of a pre-filter that filters the colours as they arrive, so each sample is filtered once rather than with
+// every window
+class PreFilterStream {
+public:
+	virtual ~PreFilterStream() = default;
+
+	// Starts from the first sample after a reset as if it had been the input forever
+	virtual void settle(const double *rgb) = 0;
+	// Filters one new R, G, B sample, taken at time, in place before it is buffered
+	virtual void process(double *rgb, double time) = 0;
+	// Colours to estimate from, given the buffer of processed samples
+	virtual const SignalBuffer &colours(const SignalBuffer &processed) = 0;
+};
+
+// One pre-filter, PPG and post-filter combination compiled into a single function
+typedef void (*PipelineFn)(PipelineData &data);
+
+// Pipeline for the pre-filter, PPG and post-filter setting values, null if any of them is unknown
+PipelineFn selectPipeline(int preFilter, int ppg, int postFilter);
+// Whether the PPG setting value estimates from the POS pulse streamed as the samples arrive, false if it is unknown
+bool ppgStreamsPulse(int ppg);
+// Stream the pre-filter keeps for windows of up to capacity samples, null if it has none or the PPG does not use the
+// colours
+std::unique_ptr<PreFilterStream> createPreFilterStream(int preFilter, int ppg, int fps, int capacity);
+
+#endif
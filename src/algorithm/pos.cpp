@@ -0,0 +1,87 @@
+#include "pos.h"
+
+#include <algorithm>
+#include <cmath>
+
+void PosStream::reset(int windowLength, int capacity)
+{
+	length = std::max(windowLength, 0);
+	received = 0;
+	next = 0;
+	colours.assign(static_cast<size_t>(length) * 3, 0.0);
+	overlap.assign(length, 0.0);
+	window.assign(length, 0.0);
+
+	cap = std::max(capacity, 0);
+	head = 0;
+	count = 0;
+	output.assign(static_cast<size_t>(cap) * 2, 0.0);
+}
+
+void PosStream::push(const double *rgb)
+{
+	if (length == 0) {
+		return;
+	}
+
+	std::copy(rgb, rgb + 3, colours.begin() + next * 3);
+	next = (next + 1) % length;
+	if (++received < length) {
+		return;
+	}
+
+	// The window is complete, oldest sample first from next
+	double mean[3] = {0.0, 0.0, 0.0};
+	for (int i = 0; i < length; ++i) {
+		for (int c = 0; c < 3; ++c) {
+			mean[c] += colours[i * 3 + c];
+		}
+	}
+	for (int c = 0; c < 3; ++c) {
+		mean[c] /= length;
+	}
+
+	// Projections of the normalised colours onto the plane orthogonal to the skin tone, (0, 1, -1) and (-2, 1, 1)
+	bool valid = mean[0] > 0.0 && mean[1] > 0.0 && mean[2] > 0.0;
+	double sum1 = 0.0, sumSquares1 = 0.0, sum2 = 0.0, sumSquares2 = 0.0;
+	for (int i = 0; valid && i < length; ++i) {
+		const double *c = colours.data() + ((next + i) % length) * 3;
+		double r = c[0] / mean[0], g = c[1] / mean[1], b = c[2] / mean[2];
+		double s1 = g - b, s2 = -2.0 * r + g + b;
+		sum1 += s1;
+		sumSquares1 += s1 * s1;
+		sum2 += s2;
+		sumSquares2 += s2 * s2;
+	}
+	double variance1 = std::max(sumSquares1 - sum1 * sum1 / length, 0.0);
+	double variance2 = std::max(sumSquares2 - sum2 * sum2 / length, 0.0);
+	double alpha = variance2 > 0.0 ? std::sqrt(variance1 / variance2) : 0.0;
+
+	// Tune the two projections against each other, then overlap-add the window without its mean
+	double windowMean = 0.0;
+	for (int i = 0; valid && i < length; ++i) {
+		const double *c = colours.data() + ((next + i) % length) * 3;
+		double r = c[0] / mean[0], g = c[1] / mean[1], b = c[2] / mean[2];
+		window[i] = (g - b) + alpha * (-2.0 * r + g + b);
+		windowMean += window[i];
+	}
+	windowMean /= length;
+	for (int i = 0; valid && i < length; ++i) {
+		overlap[(next + i) % length] += window[i] - windowMean;
+	}
+
+	// No later window covers the oldest sample, so its pulse is final
+	if (cap > 0) {
+		output[head] = overlap[next];
+		output[head + cap] = overlap[next];
+		head = (head + 1) % cap;
+		count = std::min(count + 1, cap);
+	}
+	overlap[next] = 0.0;
+}
+
+PosStream::PulseView PosStream::pulse(int n) const
+{
+	n = std::min(std::max(n, 0), count);
+	return PulseView(output.data() + (head - n + cap), n);
+}
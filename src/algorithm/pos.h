@@ -0,0 +1,43 @@
+#ifndef POS_H
+#define POS_H
+
+#include <Eigen/Dense>
+#include <algorithm>
+#include <vector>
+
+// Plane-Orthogonal-to-Skin pulse extraction (Wang et al., 2017) as a streaming stage. Every new R, G, B sample closes
+// a short window that is projected onto the plane orthogonal to the skin tone and overlap-added into the pulse, so the
+// pulse grows by one sample per input sample, windowLength - 1 samples behind it.
+class PosStream {
+public:
+	using PulseView = Eigen::Map<const Eigen::VectorXd>;
+
+	// Windows of windowLength samples, and room for capacity pulse samples
+	void reset(int windowLength, int capacity);
+	bool empty() const { return length == 0; }
+
+	// Takes raw colour means, each window is normalised by its own mean
+	void push(const double *rgb);
+
+	int size() const { return count; }
+	// Samples the pulse lags the colours by
+	int latency() const { return std::max(length - 1, 0); }
+	// Latest count pulse samples, oldest first
+	PulseView pulse(int count) const;
+
+private:
+	int length = 0;
+	int received = 0;
+	int next = 0;                // Ring slot of the next colour sample
+	std::vector<double> colours; // Last length samples, R, G, B interleaved
+	std::vector<double> overlap; // Pulse summed so far for the sample in the same slot
+	std::vector<double> window;  // Pulse of the latest window
+
+	// Completed pulse, each sample written at i and i + cap so the latest are contiguous
+	int cap = 0;
+	int head = 0;
+	int count = 0;
+	std::vector<double> output;
+};
+
+#endif
@@ -0,0 +1,44 @@
+#include "ppg.h"
+
+using namespace Eigen;
+
+void PcaPpg::project(PipelineData &data, bool heldCovariance, bool centred)
+{
+	PipelineData::ColourView rgb = data.rgb();
+	PipelineData::PulseView ppg = data.ppg();
+
+	RowVector3d mean;
+	Matrix3d cov;
+	if (heldCovariance) {
+		mean = centred ? RowVector3d::Zero() : data.colours->mean();
+		cov = data.colours->covariance();
+	} else {
+		// The colours are a copy, so they are centred in place
+		mean = rgb.colwise().mean();
+		rgb.rowwise() -= mean;
+		mean.setZero();
+		cov.noalias() = rgb.transpose() * rgb / double(rgb.rows() - 1);
+	}
+
+	SelfAdjointEigenSolver<Matrix3d> solver;
+	solver.computeDirect(cov);
+
+	// Projects onto the principal component, centred on mean
+	Vector3d pc = solver.eigenvectors().col(2);
+	ppg.noalias() = rgb * pc;
+	ppg.array() -= mean.dot(pc);
+}
+
+void ChromPpg::project(PipelineData &data)
+{
+	PipelineData::ColourView rgb = data.rgb();
+	PipelineData::PulseView Xc = data.ppg();
+	PipelineData::PulseView Yc = data.scratch();
+	Xc = 3 * rgb.col(0) - 2 * rgb.col(1);
+	Yc = 1.5 * rgb.col(0) + rgb.col(1) - 1.5 * rgb.col(2);
+
+	double sX = sqrt((Xc.array() - Xc.mean()).square().sum() / (Xc.size() - 1));
+	double sY = sqrt((Yc.array() - Yc.mean()).square().sum() / (Yc.size() - 1));
+
+	Xc -= (sX / sY) * Yc;
+}
@@ -0,0 +1,44 @@
+#ifndef PPG_H
+#define PPG_H
+
+#include "pipeline.h"
+
+// PPG stages turn the pre-filtered colours into a pulse signal. Stages that build their pulse as the samples arrive
+// stream it, and do not use the colours, which are then neither fetched nor pre-filtered, and pre-filter the pulse
+// instead.
+struct GreenPpg {
+	static constexpr bool USES_COLOURS = true;
+	static constexpr bool STREAMS_PULSE = false;
+	template<class PreFilter> static void apply(PipelineData &data) { data.ppg() = data.rgb().col(1); }
+};
+
+struct PcaPpg {
+	static constexpr bool USES_COLOURS = true;
+	static constexpr bool STREAMS_PULSE = false;
+	template<class PreFilter> static void apply(PipelineData &data)
+	{
+		project(data, PreFilter::KEEPS_COVARIANCE, PreFilter::CENTRES);
+	}
+	// Uses the colour buffer's running covariance unless the pre-filter changed it
+	static void project(PipelineData &data, bool heldCovariance, bool centred);
+};
+
+struct ChromPpg {
+	static constexpr bool USES_COLOURS = true;
+	static constexpr bool STREAMS_PULSE = false;
+	template<class PreFilter> static void apply(PipelineData &data) { project(data); }
+	static void project(PipelineData &data);
+};
+
+struct PosPpg {
+	static constexpr bool USES_COLOURS = false;
+	static constexpr bool STREAMS_PULSE = true;
+	template<class PreFilter> static void apply(PipelineData &data)
+	{
+		data.resize(data.pos->size());
+		data.ppg() = data.pos->pulse(data.pos->size());
+		PreFilter::applyToPulse(data);
+	}
+};
+
+#endif
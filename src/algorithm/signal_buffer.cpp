@@ -0,0 +1,122 @@
+#include "signal_buffer.h"
+
+#include <algorithm>
+
+SignalBuffer::SignalBuffer(int capacity)
+{
+	reset(capacity);
+}
+
+void SignalBuffer::reset(int capacity)
+{
+	cap = std::max(capacity, 0);
+	head = 0;
+	count = 0;
+	data.assign(static_cast<size_t>(NUM_CHANNELS) * 2 * cap, 0.0);
+	offset.setZero();
+	sum.setZero();
+	products.setZero();
+	pushesSinceResync = 0;
+}
+
+void SignalBuffer::push(const double *rgb, double time)
+{
+	if (cap == 0) {
+		return;
+	}
+
+	if (count == 0) {
+		offset << rgb[0], rgb[1], rgb[2];
+	} else if (count == cap) {
+		// The oldest sample is about to be overwritten
+		addToSums(Eigen::RowVector3d(data[head], data[2 * cap + head], data[4 * cap + head]), -1.0);
+	}
+	addToSums(Eigen::RowVector3d(rgb[0], rgb[1], rgb[2]), 1.0);
+
+	double values[NUM_CHANNELS] = {rgb[0], rgb[1], rgb[2], time};
+	for (int channel = 0; channel < NUM_CHANNELS; ++channel) {
+		double *block = data.data() + static_cast<size_t>(channel) * 2 * cap;
+		block[head] = values[channel];
+		block[head + cap] = values[channel];
+	}
+
+	head = (head + 1) % cap;
+	count = std::min(count + 1, cap);
+
+	if (++pushesSinceResync >= cap) {
+		resyncSums();
+	}
+}
+
+void SignalBuffer::replaceLatest(const Eigen::Ref<const Eigen::MatrixXd> &rgb)
+{
+	int n = std::min(static_cast<int>(rgb.rows()), count);
+	for (int i = 0; i < n; ++i) {
+		int index = (head - n + i + cap) % cap;
+		Eigen::RowVector3d replacement = rgb.row(rgb.rows() - n + i);
+		addToSums(Eigen::RowVector3d(data[index], data[2 * cap + index], data[4 * cap + index]), -1.0);
+		addToSums(replacement, 1.0);
+
+		for (int channel = 0; channel < 3; ++channel) {
+			double *block = data.data() + static_cast<size_t>(channel) * 2 * cap;
+			block[index] = replacement(channel);
+			block[index + cap] = replacement(channel);
+		}
+	}
+}
+
+void SignalBuffer::addToSums(const Eigen::RowVector3d &rgb, double sign)
+{
+	Eigen::RowVector3d shifted = rgb - offset;
+	sum += sign * shifted;
+	products.noalias() += sign * shifted.transpose() * shifted;
+}
+
+void SignalBuffer::resyncSums()
+{
+	pushesSinceResync = 0;
+	if (count == 0) {
+		return;
+	}
+
+	ColourView samples = colours(count);
+	offset = samples.colwise().mean();
+	sum.setZero();
+	products.setZero();
+	for (Eigen::Index i = 0; i < count; ++i) {
+		addToSums(samples.row(i), 1.0);
+	}
+}
+
+const double *SignalBuffer::latest(int channel, int n) const
+{
+	return data.data() + static_cast<size_t>(channel) * 2 * cap + (head - n + cap);
+}
+
+SignalBuffer::ColourView SignalBuffer::colours(int n) const
+{
+	n = std::min(std::max(n, 0), count);
+	return ColourView(latest(0, n), n, 3, Eigen::OuterStride<>(2 * cap));
+}
+
+SignalBuffer::TimeView SignalBuffer::times(int n) const
+{
+	n = std::min(std::max(n, 0), count);
+	return TimeView(latest(NUM_CHANNELS - 1, n), n);
+}
+
+Eigen::RowVector3d SignalBuffer::mean() const
+{
+	if (count == 0) {
+		return Eigen::RowVector3d::Zero();
+	}
+	return offset + sum / count;
+}
+
+Eigen::Matrix3d SignalBuffer::covariance() const
+{
+	if (count < 2) {
+		return Eigen::Matrix3d::Zero();
+	}
+	return (products - sum.transpose() * sum / count) / (count - 1);
+}
@@ -0,0 +1,54 @@
+#ifndef SIGNAL_BUFFER_H
+#define SIGNAL_BUFFER_H
+
+#include <Eigen/Dense>
+#include <vector>
+
+// Fixed-capacity ring of R, G, B samples and the times they were taken at. Every channel is one contiguous array
+// written twice, at i and i + capacity, so the latest samples are always contiguous and are viewed without copying.
+// Sums and cross-products of the colours are kept as samples enter and leave, so their mean and covariance are free.
+class SignalBuffer {
+public:
+	using ColourView = Eigen::Map<const Eigen::MatrixXd, 0, Eigen::OuterStride<>>;
+	using TimeView = Eigen::Map<const Eigen::VectorXd>;
+
+	explicit SignalBuffer(int capacity = 0);
+
+	// Drops every sample and makes room for capacity samples
+	void reset(int capacity);
+	void push(const double *rgb, double time);
+	// Overwrites the latest rows of R, G, B samples, keeping their times
+	void replaceLatest(const Eigen::Ref<const Eigen::MatrixXd> &rgb);
+
+	int size() const { return count; }
+	int capacity() const { return cap; }
+
+	// Latest count samples, oldest first, with one column per colour
+	ColourView colours(int count) const;
+	TimeView times(int count) const;
+
+	// Of every sample held, one entry per colour
+	Eigen::RowVector3d mean() const;
+	Eigen::Matrix3d covariance() const;
+
+private:
+	static const int NUM_CHANNELS = 4; // R, G, B and time
+
+	const double *latest(int channel, int count) const;
+	void addToSums(const Eigen::RowVector3d &rgb, double sign);
+	// Recomputes the sums from the samples held, about their mean, so rounding does not build up
+	void resyncSums();
+
+	int cap = 0;
+	int head = 0; // Where the next sample is written
+	int count = 0;
+	std::vector<double> data; // NUM_CHANNELS blocks of 2 * capacity
+
+	// Taken about offset, which stays close to the samples, to keep the cross-products well conditioned
+	Eigen::RowVector3d offset = Eigen::RowVector3d::Zero();
+	Eigen::RowVector3d sum = Eigen::RowVector3d::Zero();
+	Eigen::Matrix3d products = Eigen::Matrix3d::Zero();
+	int pushesSinceResync = 0;
+};
+
+#endif
@@ -0,0 +1,245 @@
+#include "analysis_worker.h"
+#include "plugin-support.h"
+
+#include <obs-module.h>
+#include <util/platform.h>
+#include <algorithm>
+
+void FrameQueue::push(struct analysisFrame &&frame)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (closed) {
+		return;
+	}
+	if (tail - head >= slots.size()) {
+		head++; // The worker is behind, the stalest frame is overwritten
+		dropped++;
+	}
+	slots[tail % slots.size()] = std::move(frame);
+	tail++;
+	pushed++;
+}
+
+bool FrameQueue::pop(struct analysisFrame &frame)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (closed || head == tail) {
+		return false;
+	}
+	frame = std::move(slots[head % slots.size()]);
+	head++;
+	return true;
+}
+
+bool FrameQueue::empty()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return closed || head == tail;
+}
+
+void FrameQueue::close()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	closed = true;
+	head = tail;
+	slots.fill({}); // Hands the frame buffers back to their pool
+}
+
+std::shared_ptr<AnalysisPool> AnalysisPool::get()
+{
+	static std::mutex poolMutex;
+	static std::weak_ptr<AnalysisPool> sharedPool;
+
+	std::lock_guard<std::mutex> lock(poolMutex);
+	std::shared_ptr<AnalysisPool> pool = sharedPool.lock();
+	if (!pool) {
+		size_t numThreads = std::clamp<size_t>(std::thread::hardware_concurrency(), 1, ANALYSIS_POOL_MAX_THREADS);
+		pool = std::shared_ptr<AnalysisPool>(new AnalysisPool(numThreads));
+		sharedPool = pool;
+	}
+	return pool;
+}
+
+AnalysisPool::AnalysisPool(size_t numThreads)
+{
+	for (size_t i = 0; i < numThreads; i++) {
+		threads.emplace_back(&AnalysisPool::run, this);
+	}
+	obs_log(LOG_INFO, "Started %zu analysis threads", numThreads);
+}
+
+AnalysisPool::~AnalysisPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	available.notify_all();
+	for (std::thread &thread : threads) {
+		thread.join();
+	}
+}
+
+void AnalysisPool::schedule(AnalysisWorker *worker)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		ready.push_back(worker);
+	}
+	available.notify_one();
+}
+
+void AnalysisPool::remove(AnalysisWorker *worker)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	finished.wait(lock, [this, worker] { return std::find(running.begin(), running.end(), worker) == running.end(); });
+	ready.erase(std::remove(ready.begin(), ready.end(), worker), ready.end());
+}
+
+void AnalysisPool::run()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		available.wait(lock, [this] { return stopping || !ready.empty(); });
+		if (stopping) {
+			return;
+		}
+
+		AnalysisWorker *worker = ready.front();
+		ready.pop_front();
+		running.push_back(worker);
+
+		lock.unlock();
+		worker->runOnce();
+		lock.lock();
+
+		running.erase(std::find(running.begin(), running.end(), worker));
+		finished.notify_all();
+	}
+}
+
+AnalysisWorker::AnalysisWorker() : pool(AnalysisPool::get()), result(std::make_shared<const struct analysisResult>())
+{
+}
+
+AnalysisWorker::~AnalysisWorker()
+{
+	queue.close();
+	pool->remove(this);
+
+	obs_log(LOG_INFO, "Analysis queue dropped %llu of %llu frames", (unsigned long long)queue.droppedFrames(),
+		(unsigned long long)queue.pushedFrames());
+}
+
+void AnalysisWorker::publish(struct analysisFrame &&frame)
+{
+	queue.push(std::move(frame));
+	if (!scheduled.exchange(true)) {
+		pool->schedule(this);
+	}
+}
+
+std::shared_ptr<const struct analysisResult> AnalysisWorker::latestResult()
+{
+	std::lock_guard<std::mutex> lock(resultMutex);
+	return result;
+}
+
+void AnalysisWorker::runOnce()
+{
+	struct analysisFrame frame;
+	if (queue.pop(frame)) {
+		std::shared_ptr<const struct analysisResult> next =
+			std::make_shared<const struct analysisResult>(analyse(frame));
+		frame = {};
+
+		std::lock_guard<std::mutex> lock(resultMutex);
+		result.swap(next); // The old result is released outside the lock
+	}
+
+	// One frame per turn, so a busy instance cannot starve the others. A frame published after the flag is cleared
+	// schedules the worker itself
+	scheduled.store(false);
+	if (!queue.empty() && !scheduled.exchange(true)) {
+		pool->schedule(this);
+	}
+}
+
+struct analysisResult AnalysisWorker::analyse(const struct analysisFrame &frame)
+{
+	const struct analysisSettings &settings = frame.settings;
+	struct analysisResult next;
+	std::vector<double_t> avg;
+
+	if (frame.bgraData) {
+		next.timestamp = frame.bgraData->timestamp;
+	}
+
+	// User has changed face detection algorithm, recreate the face detection object
+	if (!faceDetection || settings.faceDetectionAlgorithm != currentFaceDetectionAlgorithm) {
+		faceDetection = FaceDetection::create(static_cast<FaceDetectionAlgorithm>(settings.faceDetectionAlgorithm));
+		currentFaceDetectionAlgorithm = settings.faceDetectionAlgorithm;
+	}
+
+	if (faceDetection) {
+		uint64_t start_face_detection, end_face_detection;
+		if (enableTiming) {
+			start_face_detection = os_gettime_ns();
+		}
+		faceDetection->setMaskedMeanEnabled(!settings.gpuSkinMean);
+		avg = faceDetection->detectFace(frame.bgraData, next.faceCoordinates, settings.enableDebugBoxes,
+						settings.enableTracker, settings.frameUpdateInterval, false,
+						frame.faceCrop);
+		next.hasFaceBox = faceDetection->getFaceBox(next.faceBox);
+		faceDetection->getMaskPolygons(next.skinPolygons, next.excludedPolygons);
+		if (settings.gpuSkinMean) {
+			// The GPU mean is masked with the polygons of an earlier result, only use it while a face is found
+			avg = next.hasFaceBox ? frame.skinMean : std::vector<double_t>();
+		}
+		if (enableTiming) {
+			end_face_detection = os_gettime_ns();
+			obs_log(LOG_INFO, "Face detection took: %lu ns", end_face_detection - start_face_detection);
+		}
+	}
+
+	if (!(std::all_of(avg.begin(), avg.end(), [](double_t val) { return val == 0.0; }))) { // face detected
+		// Check if the ppg algorithm has changed
+		if (settings.ppgAlgorithm != currentPpgAlgorithm) {
+			movingAvg = MovingAvg(); // Create a new instance of MovingAvg
+			currentPpgAlgorithm = settings.ppgAlgorithm;
+		}
+
+		framesWithoutFace = 0; // reset frame count
+
+		// Where the face is, in face sizes, so windows where it moves can be told apart
+		if (next.hasFaceBox) {
+			float faceWidth = next.faceBox.y - next.faceBox.x;
+			float faceHeight = next.faceBox.w - next.faceBox.z;
+			if (faceWidth > 0.0f && faceHeight > 0.0f) {
+				movingAvg.addFacePosition(0.5 * (next.faceBox.x + next.faceBox.y) / faceWidth,
+							  0.5 * (next.faceBox.z + next.faceBox.w) / faceHeight);
+			}
+		}
+
+		double timestamp = frame.bgraData && frame.bgraData->timestamp
+					   ? static_cast<double>(frame.bgraData->timestamp) / 1000000000.0
+					   : -1.0;
+		next.heartRate = movingAvg.calculateHeartRate(avg, settings.preFiltering, settings.ppgAlgorithm,
+							      settings.postFiltering, true, settings.fps, 1, timestamp,
+							      static_cast<int>(settings.spectralEstimator));
+		next.provisional = movingAvg.isProvisional();
+		next.confidence = movingAvg.getConfidence();
+		next.hrv = movingAvg.getHrv();
+
+		const std::vector<double_t> &ppg = movingAvg.getLatestPpg();
+		size_t numBvp = std::min<size_t>(ppg.size(), METRIC_BVP_SAMPLES);
+		next.bvp.assign(ppg.end() - numBvp, ppg.end());
+	} else { // no face detected
+		framesWithoutFace += 1;
+		if (framesWithoutFace >= settings.fps) { // if no face detected more than 1 second
+			next.noFaceDetected = true;
+		}
+	}
+
+	return next;
+}
@@ -0,0 +1,145 @@
+#ifndef ANALYSIS_WORKER_H
+#define ANALYSIS_WORKER_H
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "heart_rate_source.h"
+#include "algorithm/face_detection/face_detection.h"
+#include "algorithm/heart_rate_algorithm.h"
+
+// Frames waiting for analysis, kept small so results never lag far behind the video
+#define ANALYSIS_QUEUE_CAPACITY 4
+// Frame buffers each instance needs, for the queued frames plus the one being analysed and the one being copied
+#define NUM_FRAME_BUFFERS (ANALYSIS_QUEUE_CAPACITY + 2)
+// Most threads the shared analysis pool uses, one per instance up to this many
+#define ANALYSIS_POOL_MAX_THREADS 4
+
+// Filter settings captured on the render thread, so the worker never reads obs_data itself
+struct analysisSettings {
+	int64_t faceDetectionAlgorithm;
+	bool enableDebugBoxes;
+	bool enableTracker;
+	int64_t frameUpdateInterval;
+	int64_t fps;
+	int64_t ppgAlgorithm;
+	int64_t preFiltering;
+	int64_t postFiltering;
+	int64_t spectralEstimator;
+	bool gpuSkinMean;
+};
+
+struct analysisFrame {
+	std::shared_ptr<struct input_BGRA_data> bgraData;
+	std::shared_ptr<struct input_BGRA_data> faceCrop;
+	std::vector<double_t> skinMean; // R, G, B mean reduced on the GPU, empty if not available
+	struct analysisSettings settings;
+};
+
+struct analysisResult {
+	std::vector<struct vec4> faceCoordinates;
+	struct vec4 faceBox;
+	bool hasFaceBox = false;
+	std::vector<std::vector<struct vec2>> skinPolygons;
+	std::vector<std::vector<struct vec2>> excludedPolygons;
+	double heartRate = -1.0;
+	bool provisional = false; // heartRate is a rough estimate made while calibrating
+	double confidence = -1.0; // From 0 to 1, or -1 if not estimated
+	HrvStats hrv;
+	bool noFaceDetected = false;
+	uint64_t timestamp = 0;  // Video frame time of the analysed frame, in nanoseconds
+	std::vector<float> bvp; // Tail of the latest pulse signal, oldest first
+};
+
+// Bounded single-producer/single-consumer queue on a fixed ring of slots, so queueing a frame never allocates. When
+// full, the oldest frame is dropped in favour of the new one.
+class FrameQueue {
+public:
+	void push(struct analysisFrame &&frame);
+	// Returns false if no frame is waiting or the queue is closed
+	bool pop(struct analysisFrame &frame);
+	bool empty();
+	void close();
+
+	uint64_t pushedFrames() const { return pushed.load(); }
+	uint64_t droppedFrames() const { return dropped.load(); }
+
+private:
+	std::array<struct analysisFrame, ANALYSIS_QUEUE_CAPACITY> slots;
+	uint64_t head = 0; // Count of frames popped or dropped, the oldest waiting frame is in slot head % capacity
+	uint64_t tail = 0; // Count of frames pushed, the next one goes in slot tail % capacity
+	std::mutex mutex;
+	bool closed = false;
+	std::atomic<uint64_t> pushed{0};
+	std::atomic<uint64_t> dropped{0};
+};
+
+class AnalysisWorker;
+
+// Threads shared by every filter instance. A worker with frames waiting is queued here and is only ever run by one
+// thread at a time, so its estimator state needs no locking while different instances run on different cores.
+class AnalysisPool {
+public:
+	// The pool is created with the first filter instance and stopped with the last
+	static std::shared_ptr<AnalysisPool> get();
+	~AnalysisPool();
+
+	void schedule(AnalysisWorker *worker);
+	// Waits for the worker to finish running and removes it from the pool
+	void remove(AnalysisWorker *worker);
+
+private:
+	explicit AnalysisPool(size_t numThreads);
+	void run();
+
+	std::vector<std::thread> threads;
+	std::deque<AnalysisWorker *> ready;
+	std::vector<AnalysisWorker *> running;
+	std::mutex mutex;
+	std::condition_variable available;
+	std::condition_variable finished;
+	bool stopping = false;
+};
+
+// Face detection and heart rate estimation state for one filter instance, run on the shared analysis pool
+class AnalysisWorker {
+public:
+	AnalysisWorker();
+	~AnalysisWorker();
+
+	// Called from the render thread, never blocks on the analysis
+	void publish(struct analysisFrame &&frame);
+	// Shared rather than copied, as the render thread reads it every frame. Never null
+	std::shared_ptr<const struct analysisResult> latestResult();
+
+	uint64_t pushedFrames() const { return queue.pushedFrames(); }
+	uint64_t droppedFrames() const { return queue.droppedFrames(); }
+
+private:
+	friend class AnalysisPool;
+
+	// Analyses one waiting frame on a pool thread, then queues the worker again if more frames are waiting
+	void runOnce();
+	struct analysisResult analyse(const struct analysisFrame &frame);
+
+	std::shared_ptr<AnalysisPool> pool;
+	FrameQueue queue;
+	std::atomic<bool> scheduled{false};
+
+	std::mutex resultMutex;
+	std::shared_ptr<const struct analysisResult> result;
+
+	std::unique_ptr<FaceDetection> faceDetection;
+	MovingAvg movingAvg;
+	int64_t currentFaceDetectionAlgorithm = -1;
+	int64_t currentPpgAlgorithm = -1;
+	int framesWithoutFace = 0;
+};
+
+#endif
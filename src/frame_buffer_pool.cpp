@@ -0,0 +1,112 @@
+#include "frame_buffer_pool.h"
+
+#include <obs-module.h>
+
+// Allocator that places the shared_ptr control block inside the frame buffer itself. The buffer is handed back when
+// the control block is deallocated rather than in the deleter, since the control block is still in use at that point.
+template<class T> struct controlBlockAllocator {
+	using value_type = T;
+
+	controlBlockAllocator(struct FrameBufferPool::frameBuffer *buffer, std::weak_ptr<FrameBufferPool> pool)
+		: buffer(buffer),
+		  pool(std::move(pool))
+	{
+	}
+	template<class U>
+	controlBlockAllocator(const controlBlockAllocator<U> &other) : buffer(other.buffer), pool(other.pool)
+	{
+	}
+
+	T *allocate(size_t n)
+	{
+		static_assert(sizeof(T) <= FRAME_CONTROL_BLOCK_SIZE, "FRAME_CONTROL_BLOCK_SIZE is too small");
+		UNUSED_PARAMETER(n);
+		return reinterpret_cast<T *>(buffer->controlBlock);
+	}
+	void deallocate(T *, size_t)
+	{
+		if (std::shared_ptr<FrameBufferPool> owner = pool.lock()) {
+			owner->release(buffer);
+		} else {
+			FrameBufferPool::freeBuffer(buffer);
+		}
+	}
+
+	template<class U> bool operator==(const controlBlockAllocator<U> &other) const
+	{
+		return buffer == other.buffer;
+	}
+	template<class U> bool operator!=(const controlBlockAllocator<U> &other) const
+	{
+		return buffer != other.buffer;
+	}
+
+	struct FrameBufferPool::frameBuffer *buffer;
+	std::weak_ptr<FrameBufferPool> pool;
+};
+
+std::shared_ptr<FrameBufferPool> FrameBufferPool::create(size_t numBuffers)
+{
+	return std::shared_ptr<FrameBufferPool>(new FrameBufferPool(numBuffers));
+}
+
+FrameBufferPool::FrameBufferPool(size_t numBuffers)
+{
+	freeBuffers.reserve(numBuffers);
+	for (size_t i = 0; i < numBuffers; i++) {
+		struct frameBuffer *buffer = new frameBuffer();
+		freeBuffers.push_back(buffer);
+	}
+}
+
+FrameBufferPool::~FrameBufferPool()
+{
+	// Buffers still in use are freed by their deleter once released
+	for (struct frameBuffer *buffer : freeBuffers) {
+		freeBuffer(buffer);
+	}
+}
+
+void FrameBufferPool::freeBuffer(struct frameBuffer *buffer)
+{
+	bfree(buffer->frame.data);
+	delete buffer;
+}
+
+void FrameBufferPool::release(struct frameBuffer *buffer)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	freeBuffers.push_back(buffer);
+}
+
+std::shared_ptr<struct input_BGRA_data> FrameBufferPool::acquire(uint32_t width, uint32_t height, uint32_t linesize)
+{
+	struct frameBuffer *buffer;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (freeBuffers.empty()) {
+			return nullptr;
+		}
+		buffer = freeBuffers.back();
+		freeBuffers.pop_back();
+	}
+
+	// Buffers only grow, so once every buffer has seen the largest frame size nothing is allocated any more.
+	// bmalloc returns memory aligned for SIMD loads.
+	size_t size = static_cast<size_t>(linesize) * height;
+	if (buffer->capacity < size) {
+		bfree(buffer->frame.data);
+		buffer->frame.data = static_cast<uint8_t *>(bmalloc(size));
+		buffer->capacity = size;
+	}
+
+	buffer->frame.width = width;
+	buffer->frame.height = height;
+	buffer->frame.linesize = linesize;
+	vec4_set(&buffer->frame.region, 0.0f, 1.0f, 0.0f, 1.0f);
+	buffer->frame.timestamp = 0;
+
+	return std::shared_ptr<struct input_BGRA_data>(
+		&buffer->frame, [](struct input_BGRA_data *) {},
+		controlBlockAllocator<struct input_BGRA_data>(buffer, weak_from_this()));
+}
@@ -0,0 +1,41 @@
+#ifndef FRAME_BUFFER_POOL_H
+#define FRAME_BUFFER_POOL_H
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "heart_rate_source.h"
+
+// Room for the shared_ptr control block, so handing out a frame does not allocate
+#define FRAME_CONTROL_BLOCK_SIZE 64
+
+// A fixed set of owned, reusable frame buffers. A frame goes back to the pool when its last shared_ptr is released,
+// so frames can safely outlive the stage surface they were copied from and be used from other threads. Buffer memory
+// is only allocated when a buffer is first handed out, and grown to the largest frame it has held.
+class FrameBufferPool : public std::enable_shared_from_this<FrameBufferPool> {
+public:
+	static std::shared_ptr<FrameBufferPool> create(size_t numBuffers);
+	~FrameBufferPool();
+
+	// Returns a frame with room for height rows of linesize bytes, or nullptr if every buffer is in use
+	std::shared_ptr<struct input_BGRA_data> acquire(uint32_t width, uint32_t height, uint32_t linesize);
+
+	struct frameBuffer {
+		struct input_BGRA_data frame;
+		size_t capacity;
+		alignas(std::max_align_t) unsigned char controlBlock[FRAME_CONTROL_BLOCK_SIZE];
+	};
+
+	static void freeBuffer(struct frameBuffer *buffer);
+	void release(struct frameBuffer *buffer);
+
+private:
+	explicit FrameBufferPool(size_t numBuffers);
+
+	std::mutex mutex;
+	std::vector<struct frameBuffer *> freeBuffers;
+};
+
+#endif
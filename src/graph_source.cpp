@@ -16,6 +16,7 @@
 #include "graph_source.h"
 #include "graph_source_info.h"
 #include "heart_rate_source.h"
+#include "metric_channel.h"
 #include <chrono>
 
 #define LINE_THICKNESS 3.0f
@@ -49,32 +50,6 @@ void destroyGraphSource(void *data)
 	}
 }
 
-static bool findHeartRateMonitorFilter(void *param, obs_source_t *source)
-{
-	const char *filterName = MONITOR_SOURCE_NAME;
-
-	// Try to get the filter from the current source
-	obs_source_t *filter = obs_source_get_filter_by_name(source, filterName);
-
-	if (filter) {
-		// Store the filter reference in param
-		*(obs_source_t **)param = filter;
-		return false; // Stop further enumeration
-	}
-
-	return true; // Continue searching
-}
-
-obs_source_t *getHeartRateMonitorFilter()
-{
-	obs_source_t *found_filter = nullptr;
-
-	// Enumerate all sources to find the desired filter
-	obs_enum_sources(findHeartRateMonitorFilter, &found_filter);
-
-	return found_filter; // Return the filter reference (must be released later)
-}
-
 void graphSourceRender(void *data, gs_effect_t *effect)
 {
 	UNUSED_PARAMETER(effect);
@@ -84,24 +59,15 @@ void graphSourceRender(void *data, gs_effect_t *effect)
 		return; // Ensure graphSource is valid
 	}
 
+	// Nothing to draw until a heart rate monitor filter publishes
+	if (!graphSource->channel->hasPublisher() || graphSource->channel->config().isDisabled) {
+		return;
+	}
+
 	int curHeartRate = -1;
 
 	if (graphSource->ecg || frameCount % UPDATE_FREQUENCY == 0) {
-		// Retrieve OBS settings for the heart rate monitor source
-		obs_source_t *heartRateSource = getHeartRateMonitorFilter();
-		if (!heartRateSource) {
-			return;
-		}
-		obs_data_t *hrsSettings = obs_source_get_settings(heartRateSource);
-
-		if (obs_data_get_bool(hrsSettings, "is disabled")) {
-			obs_data_release(hrsSettings);
-			obs_source_release(heartRateSource);
-			return;
-		}
-		curHeartRate = obs_data_get_int(hrsSettings, "heart rate"); // Retrieve heart rate
-		obs_data_release(hrsSettings);
-		obs_source_release(heartRateSource);
+		curHeartRate = static_cast<int>(std::round(graphSource->channel->metrics().heartRate));
 	}
 	frameCount++;
 
@@ -181,13 +147,8 @@ void drawGraph(struct graph_source *graphSource, int curHeartRate, bool ecg)
 	// Retrieve source width and height
 	uint32_t width = obs_source_get_width(graphSource->source);
 	uint32_t height = obs_source_get_height(graphSource->source);
-	obs_source_t *heartRateSource = getHeartRateMonitorFilter();
-	if (!heartRateSource) {
-		obs_log(LOG_INFO, "Failed to get heart rate source");
-		return;
-	}
-	obs_data_t *hrsSettings = obs_source_get_settings(heartRateSource);
-	int graphSize = obs_data_get_int(hrsSettings, "heart rate graph size");
+	struct graphDisplayConfig config = graphSource->channel->config();
+	int graphSize = static_cast<int>(config.graphSize);
 
 	if (width == 0 || height == 0 || graphSize == 0)
 		return; // Avoid division by zero
@@ -214,7 +175,7 @@ void drawGraph(struct graph_source *graphSource, int curHeartRate, bool ecg)
 	gs_effect_t *effect = obs_get_base_effect(OBS_EFFECT_SOLID);
 	while (gs_effect_loop(effect, "Solid")) {
 		if (!ecg) {
-			int background = obs_data_get_int(hrsSettings, "graph plane dropdown");
+			int background = static_cast<int>(config.graphPlane);
 			if (background == 1) {
 				// **Draw background stripes for heart rate regions**
 				struct {
@@ -245,7 +206,7 @@ void drawGraph(struct graph_source *graphSource, int curHeartRate, bool ecg)
 				}
 			} else if (background == 2) {
 				// Get the colour of the graph plane from the colour picker, convert it to ARGB instead of ABGR
-				uint32_t graphPlaneAbgrColour = obs_data_get_int(hrsSettings, "graph plane colour");
+				uint32_t graphPlaneAbgrColour = config.graphPlaneColour;
 				uint32_t graphPlaneArgbColour =
 					(graphPlaneAbgrColour & 0xFF000000) | ((graphPlaneAbgrColour & 0xFF) << 16) |
 					(graphPlaneAbgrColour & 0xFF00) | ((graphPlaneAbgrColour & 0xFF0000) >> 16);
@@ -262,8 +223,7 @@ void drawGraph(struct graph_source *graphSource, int curHeartRate, bool ecg)
 
 			if (ecg) {
 				// Get the colour of the ecg background from the colour picker, convert it to RGB instead of BGR
-				uint32_t ecgBackgroundAbgrColour =
-					obs_data_get_int(hrsSettings, "ecg background colour");
+				uint32_t ecgBackgroundAbgrColour = config.ecgBackgroundColour;
 				uint32_t ecgBackgroundArgbColour = (ecgBackgroundAbgrColour & 0xFF000000) |
 								   ((ecgBackgroundAbgrColour & 0xFF) << 16) |
 								   (ecgBackgroundAbgrColour & 0xFF00) |
@@ -319,7 +279,7 @@ void drawGraph(struct graph_source *graphSource, int curHeartRate, bool ecg)
 				}
 
 				// Get the colour of the ecg line from the colour picker, convert it to RGB instead of BGR
-				uint32_t ecgLineAbgrColour = obs_data_get_int(hrsSettings, "ecg line colour");
+				uint32_t ecgLineAbgrColour = config.ecgLineColour;
 				uint32_t ecgLineArgbColour =
 					(ecgLineAbgrColour & 0xFF000000) | ((ecgLineAbgrColour & 0xFF) << 16) |
 					(ecgLineAbgrColour & 0xFF00) | ((ecgLineAbgrColour & 0xFF0000) >> 16);
@@ -345,7 +305,7 @@ void drawGraph(struct graph_source *graphSource, int curHeartRate, bool ecg)
 				}
 
 				// Get the colour of the graph line from the colour picker, convert it to RGB instead of BGR
-				uint32_t graphLineAbgrColour = obs_data_get_int(hrsSettings, "graph line colour");
+				uint32_t graphLineAbgrColour = config.graphLineColour;
 				uint32_t graphLineArgbColour =
 					(graphLineAbgrColour & 0xFF000000) | ((graphLineAbgrColour & 0xFF) << 16) |
 					(graphLineAbgrColour & 0xFF00) | ((graphLineAbgrColour & 0xFF0000) >> 16);
@@ -377,9 +337,6 @@ void drawGraph(struct graph_source *graphSource, int curHeartRate, bool ecg)
 		}
 	}
 
-	obs_data_release(hrsSettings);
-	obs_source_release(heartRateSource);
-
 	obs_leave_graphics();
 }
 
@@ -411,6 +368,7 @@ static void *createGeneralGraphSourceInfo(obs_source_t *source, bool ecg)
 
 	graphSrc->isDisabled = false;
 	graphSrc->ecg = ecg;
+	graphSrc->channel = &MetricChannel::get();
 
 	return graphSrc;
 }
@@ -427,15 +385,11 @@ void *createECGSourceInfo(obs_data_t *settings, obs_source_t *source)
 
 uint32_t graphSourceInfoGetWidth(void *data)
 {
-	UNUSED_PARAMETER(data);
-	obs_source_t *hrs = getHeartRateMonitorFilter();
-	if (!hrs) {
+	struct graph_source *graphSource = reinterpret_cast<struct graph_source *>(data);
+	if (!graphSource->channel->hasPublisher()) {
 		return 0;
 	}
-	obs_data_t *settings = obs_source_get_settings(hrs);
-	int size = obs_data_get_int(settings, "heart rate graph size");
-	obs_data_release(settings);
-	obs_source_release(hrs);
+	int64_t size = graphSource->channel->config().graphSize;
 	if (size < 20) {
 		return 260;
 	} else if (size < 30) {
@@ -5,6 +5,8 @@
 
 #ifdef __cplusplus
 #include <mutex>
+#include <vector>
+class MetricChannel;
 #else
 #include <stdbool.h>
 #endif
@@ -17,6 +19,7 @@ struct graph_source {
 	obs_source_t *source;
 #ifdef __cplusplus
 	std::vector<int> buffer;
+	MetricChannel *channel; // Where the heart rate filter publishes, subscribed once on creation
 #endif
 	bool isDisabled;
 	bool ecg;
@@ -1,8 +1,8 @@
 #include "algorithm/face_detection/face_detection.h"
-#include "algorithm/face_detection/opencv_haarcascade.h"
-#include "algorithm/face_detection/opencv_dlib_68_landmarks_face_tracker.h"
 #include "algorithm/heart_rate_algorithm.h"
 #include "heart_rate_source.h"
+#include "analysis_worker.h"
+#include "frame_buffer_pool.h"
 #include "plugin-support.h"
 
 #include <obs-module.h>
@@ -13,13 +13,14 @@
 #include <graphics/graphics.h>
 #include <graphics/matrix4.h>
 #include <util/platform.h>
+#include <algorithm>
+#include <cmath>
 #include <vector>
 #include <sstream>
 #include "plugin-support.h"
 #include "obs_utils.h"
 #include "heart_rate_source.h"
 
-MovingAvg movingAvg;
 bool enableTiming = false;
 
 const char *getHeartRateSourceName(void *)
@@ -268,6 +269,293 @@ static void createOBSHeartDisplaySourceIfNeeded(obs_data_t *settings)
 	obs_source_release(sceneAsSource);
 }
 
+static void stageRingDestroy(struct stageRing *ring)
+{
+	for (int i = 0; i < NUM_STAGE_SURFACES; i++) {
+		if (ring->surfaces[i]) {
+			gs_stagesurface_destroy(ring->surfaces[i]);
+			ring->surfaces[i] = nullptr;
+		}
+		ring->staged[i] = false;
+	}
+	ring->writeIndex = 0;
+}
+
+// Queue a GPU copy of the texture into the next surface of the ring, (re)creating it if the size has changed
+static void stageRingStage(struct stageRing *ring, gs_texture_t *texture, uint32_t width, uint32_t height,
+			   const struct vec4 *region, uint64_t frame, enum gs_color_format format = GS_BGRA)
+{
+	uint32_t index = ring->writeIndex;
+	gs_stagesurf_t *surface = ring->surfaces[index];
+
+	if (surface && (gs_stagesurface_get_width(surface) != width || gs_stagesurface_get_height(surface) != height)) {
+		gs_stagesurface_destroy(surface);
+		surface = nullptr;
+	}
+	if (!surface) {
+		surface = gs_stagesurface_create(width, height, format);
+		ring->surfaces[index] = surface;
+	}
+
+	gs_stage_texture(surface, texture);
+	ring->staged[index] = true;
+	ring->stagedFrame[index] = frame;
+	ring->stagedTime[index] = obs_get_video_frame_time();
+	ring->region[index] = *region;
+	ring->writeIndex = (index + 1) % NUM_STAGE_SURFACES;
+}
+
+// Map the oldest staged surface once it is at least NUM_STAGE_SURFACES - 1 frames old, so mapping never waits on
+// the GPU. Returns the mapped slot, or -1 if nothing is ready yet
+static int stageRingMap(struct stageRing *ring, uint64_t frame, uint8_t **data, uint32_t *linesize)
+{
+	int oldest = -1;
+	for (int i = 0; i < NUM_STAGE_SURFACES; i++) {
+		if (ring->staged[i] && (oldest < 0 || ring->stagedFrame[i] < ring->stagedFrame[oldest])) {
+			oldest = i;
+		}
+	}
+
+	if (oldest < 0 || frame - ring->stagedFrame[oldest] < NUM_STAGE_SURFACES - 1) {
+		return -1;
+	}
+
+	ring->staged[oldest] = false;
+	if (!gs_stagesurface_map(ring->surfaces[oldest], data, linesize)) {
+		return -1;
+	}
+	return oldest;
+}
+
+static void stageRingUnmap(struct stageRing *ring, int slot)
+{
+	gs_stagesurface_unmap(ring->surfaces[slot]);
+}
+
+// Copy a mapped stage surface into memory owned by the frame, so it stays valid for the analysis thread
+static std::shared_ptr<input_BGRA_data> createBGRAData(FrameBufferPool *pool, struct stageRing *ring, int slot,
+							uint8_t *data, uint32_t linesize)
+{
+	uint32_t width = gs_stagesurface_get_width(ring->surfaces[slot]);
+	uint32_t height = gs_stagesurface_get_height(ring->surfaces[slot]);
+
+	// Every buffer is still queued or being analysed, so this frame is skipped
+	std::shared_ptr<input_BGRA_data> bgraData = pool->acquire(width, height, linesize);
+	if (!bgraData) {
+		return nullptr;
+	}
+
+	memcpy(bgraData->data, data, static_cast<size_t>(linesize) * height);
+	bgraData->region = ring->region[slot];
+	bgraData->timestamp = ring->stagedTime[slot];
+	return bgraData;
+}
+
+// Draw the (x, y, cx, cy) pixel region of a texture scaled to fill a width x height texrender
+static bool renderScaledRegion(gs_texrender_t *texrender, gs_texture_t *texture, uint32_t x, uint32_t y, uint32_t cx,
+			       uint32_t cy, uint32_t width, uint32_t height)
+{
+	gs_texrender_reset(texrender);
+	if (!gs_texrender_begin(texrender, width, height)) {
+		return false;
+	}
+
+	struct vec4 background;
+	vec4_zero(&background);
+	gs_clear(GS_CLEAR_COLOR, &background, 0.0f, 0);
+	gs_ortho(0.0f, static_cast<float>(cx), 0.0f, static_cast<float>(cy), -100.0f, 100.0f);
+
+	gs_blend_state_push();
+	gs_blend_function(GS_BLEND_ONE, GS_BLEND_ZERO);
+
+	gs_effect_t *effect = obs_get_base_effect(OBS_EFFECT_DEFAULT);
+	gs_effect_set_texture(gs_effect_get_param_by_name(effect, "image"), texture);
+	while (gs_effect_loop(effect, "Draw")) {
+		gs_draw_sprite_subregion(texture, 0, x, y, cx, cy);
+	}
+
+	gs_blend_state_pop();
+	gs_texrender_end(texrender);
+	return true;
+}
+
+// Size of the face crop along one axis of limit pixels, given the size the face needs. The crop only changes size when
+// the face outgrows it or needs two steps less, so jitter in the face box does not recreate the crop surfaces
+static uint32_t faceCropSize(uint32_t current, uint32_t needed, uint32_t limit)
+{
+	if (current < needed || current > needed + 2 * FACE_CROP_STEP) {
+		current = (needed + FACE_CROP_STEP - 1) / FACE_CROP_STEP * FACE_CROP_STEP;
+	}
+	return std::min(current, limit);
+}
+
+// Stage a downscaled copy of the frame for face detection, plus a full-resolution crop around the last known face
+static void stageDownscaled(struct heartRateSource *hrs, gs_texture_t *texture, uint32_t width, uint32_t height)
+{
+	struct vec4 fullFrame;
+	vec4_set(&fullFrame, 0.0f, 1.0f, 0.0f, 1.0f);
+
+	uint32_t detectionHeight = std::min<uint32_t>(height, DETECTION_HEIGHT);
+	uint32_t detectionWidth = std::max<uint32_t>(1, static_cast<uint32_t>(
+								static_cast<uint64_t>(width) * detectionHeight / height));
+	if (renderScaledRegion(hrs->detectionTexrender, texture, 0, 0, width, height, detectionWidth,
+			       detectionHeight)) {
+		stageRingStage(&hrs->stageRing, gs_texrender_get_texture(hrs->detectionTexrender), detectionWidth,
+			       detectionHeight, &fullFrame, hrs->renderFrame);
+	}
+
+	// The crop is only used for the CPU skin mean
+	if (!hrs->hasFaceBox || hrs->gpuSkinMean) {
+		return;
+	}
+
+	// Grow the face box so the face stays inside the crop while it moves during the readback latency
+	float faceWidth = std::clamp(hrs->faceBox.y - hrs->faceBox.x, 0.0f, 1.0f);
+	float faceHeight = std::clamp(hrs->faceBox.w - hrs->faceBox.z, 0.0f, 1.0f);
+	uint32_t neededWidth = static_cast<uint32_t>(std::ceil(faceWidth * (1.0f + 2.0f * FACE_CROP_MARGIN) * width));
+	uint32_t neededHeight =
+		static_cast<uint32_t>(std::ceil(faceHeight * (1.0f + 2.0f * FACE_CROP_MARGIN) * height));
+	if (neededWidth == 0 || neededHeight == 0) {
+		return;
+	}
+	hrs->cropWidth = faceCropSize(hrs->cropWidth, neededWidth, width);
+	hrs->cropHeight = faceCropSize(hrs->cropHeight, neededHeight, height);
+	uint32_t cropWidth = hrs->cropWidth;
+	uint32_t cropHeight = hrs->cropHeight;
+
+	// Centre the crop on the face, moved inside the frame at the edges
+	double centreX = 0.5 * (hrs->faceBox.x + hrs->faceBox.y) * width;
+	double centreY = 0.5 * (hrs->faceBox.z + hrs->faceBox.w) * height;
+	uint32_t minX = static_cast<uint32_t>(std::clamp<int64_t>(std::lround(centreX - 0.5 * cropWidth), 0,
+								  static_cast<int64_t>(width - cropWidth)));
+	uint32_t minY = static_cast<uint32_t>(std::clamp<int64_t>(std::lround(centreY - 0.5 * cropHeight), 0,
+								  static_cast<int64_t>(height - cropHeight)));
+
+	struct vec4 cropRegion;
+	vec4_set(&cropRegion, static_cast<float>(minX) / width, static_cast<float>(minX + cropWidth) / width,
+		 static_cast<float>(minY) / height, static_cast<float>(minY + cropHeight) / height);
+	if (renderScaledRegion(hrs->cropTexrender, texture, minX, minY, cropWidth, cropHeight, cropWidth,
+			       cropHeight)) {
+		stageRingStage(&hrs->cropRing, gs_texrender_get_texture(hrs->cropTexrender), cropWidth, cropHeight,
+			       &cropRegion, hrs->renderFrame);
+	}
+}
+
+static void drawMaskPolygons(gs_effect_t *solid, const std::vector<std::vector<struct vec2>> &polygons, float value)
+{
+	struct vec4 colour;
+	vec4_set(&colour, value, value, value, 1.0f);
+	gs_effect_set_vec4(gs_effect_get_param_by_name(solid, "color"), &colour);
+
+	while (gs_effect_loop(solid, "Solid")) {
+		for (const auto &polygon : polygons) {
+			if (polygon.size() < 3) {
+				continue;
+			}
+			// The mask polygons are convex, so draw each one as a triangle fan
+			gs_render_start(true);
+			for (size_t i = 1; i + 1 < polygon.size(); i++) {
+				gs_vertex2f(polygon[0].x, polygon[0].y);
+				gs_vertex2f(polygon[i].x, polygon[i].y);
+				gs_vertex2f(polygon[i + 1].x, polygon[i + 1].y);
+			}
+			gs_render_stop(GS_TRIS);
+		}
+	}
+}
+
+// Rasterise the skin mask of the last result over the face, multiply it into the frame and reduce it to a single
+// {r * mask, g * mask, b * mask, mask} pixel, so only that pixel has to be read back for the skin mean
+static void stageSkinMean(struct heartRateSource *hrs, gs_texture_t *texture, uint32_t width, uint32_t height)
+{
+	float minX = 1.0f, maxX = 0.0f, minY = 1.0f, maxY = 0.0f;
+	for (const auto &polygon : hrs->shownResult->skinPolygons) {
+		for (const auto &point : polygon) {
+			minX = std::min(minX, point.x);
+			maxX = std::max(maxX, point.x);
+			minY = std::min(minY, point.y);
+			maxY = std::max(maxY, point.y);
+		}
+	}
+
+	uint32_t x = static_cast<uint32_t>(std::clamp(minX, 0.0f, 1.0f) * width);
+	uint32_t y = static_cast<uint32_t>(std::clamp(minY, 0.0f, 1.0f) * height);
+	uint32_t cx = static_cast<uint32_t>(std::ceil(std::clamp(maxX, 0.0f, 1.0f) * width)) - x;
+	uint32_t cy = static_cast<uint32_t>(std::ceil(std::clamp(maxY, 0.0f, 1.0f) * height)) - y;
+	if (cx == 0 || cy == 0 || maxX <= minX || maxY <= minY) {
+		return;
+	}
+
+	// Area of the frame that is masked, in whole pixels so the mask lines up with the sampled frame
+	struct vec4 region;
+	vec4_set(&region, static_cast<float>(x) / width, static_cast<float>(x + cx) / width,
+		 static_cast<float>(y) / height, static_cast<float>(y + cy) / height);
+
+	struct vec4 background;
+	vec4_zero(&background);
+
+	gs_blend_state_push();
+	gs_blend_function(GS_BLEND_ONE, GS_BLEND_ZERO);
+
+	// Mask of the skin, excluding the eyes and mouth, drawn in normalised frame coordinates
+	gs_texrender_reset(hrs->maskTexrender);
+	if (!gs_texrender_begin(hrs->maskTexrender, SKIN_MEAN_SIZE, SKIN_MEAN_SIZE)) {
+		gs_blend_state_pop();
+		return;
+	}
+	gs_clear(GS_CLEAR_COLOR, &background, 0.0f, 0);
+	gs_ortho(region.x, region.y, region.z, region.w, -100.0f, 100.0f);
+	gs_effect_t *solid = obs_get_base_effect(OBS_EFFECT_SOLID);
+	drawMaskPolygons(solid, hrs->shownResult->skinPolygons, 1.0f);
+	drawMaskPolygons(solid, hrs->shownResult->excludedPolygons, 0.0f);
+	gs_texrender_end(hrs->maskTexrender);
+
+	// Frame multiplied by the mask
+	gs_effect_t *effect = hrs->skinMeanEffect;
+	gs_texrender_reset(hrs->skinMeanTexrenders[0]);
+	if (!gs_texrender_begin(hrs->skinMeanTexrenders[0], SKIN_MEAN_SIZE, SKIN_MEAN_SIZE)) {
+		gs_blend_state_pop();
+		return;
+	}
+	gs_clear(GS_CLEAR_COLOR, &background, 0.0f, 0);
+	gs_ortho(0.0f, static_cast<float>(cx), 0.0f, static_cast<float>(cy), -100.0f, 100.0f);
+	gs_effect_set_texture(gs_effect_get_param_by_name(effect, "image"), texture);
+	gs_effect_set_texture(gs_effect_get_param_by_name(effect, "mask"),
+			      gs_texrender_get_texture(hrs->maskTexrender));
+	gs_effect_set_vec4(gs_effect_get_param_by_name(effect, "region"), &region);
+	while (gs_effect_loop(effect, "Multiply")) {
+		gs_draw_sprite_subregion(texture, 0, x, y, cx, cy);
+	}
+	gs_texrender_end(hrs->skinMeanTexrenders[0]);
+
+	// Each pass averages 4x4 blocks, 256 -> 64 -> 16 -> 4 -> 1
+	uint32_t size = SKIN_MEAN_SIZE;
+	for (int pass = 1; pass < SKIN_MEAN_PASSES; pass++) {
+		gs_texture_t *input = gs_texrender_get_texture(hrs->skinMeanTexrenders[pass - 1]);
+		struct vec2 texelSize;
+		vec2_set(&texelSize, 1.0f / size, 1.0f / size);
+		size /= 4;
+
+		gs_texrender_reset(hrs->skinMeanTexrenders[pass]);
+		if (!gs_texrender_begin(hrs->skinMeanTexrenders[pass], size, size)) {
+			gs_blend_state_pop();
+			return;
+		}
+		gs_ortho(0.0f, static_cast<float>(size), 0.0f, static_cast<float>(size), -100.0f, 100.0f);
+		gs_effect_set_texture(gs_effect_get_param_by_name(effect, "image"), input);
+		gs_effect_set_vec2(gs_effect_get_param_by_name(effect, "texelSize"), &texelSize);
+		while (gs_effect_loop(effect, "Reduce")) {
+			gs_draw_sprite(input, 0, size, size);
+		}
+		gs_texrender_end(hrs->skinMeanTexrenders[pass]);
+	}
+
+	gs_blend_state_pop();
+
+	stageRingStage(&hrs->skinMeanRing, gs_texrender_get_texture(hrs->skinMeanTexrenders[SKIN_MEAN_PASSES - 1]), 1,
+		       1, &region, hrs->renderFrame, GS_RGBA32F);
+}
+
 // Create function
 void *heartRateSourceCreate(obs_data_t *settings, obs_source_t *source)
 {
@@ -275,7 +563,6 @@ void *heartRateSourceCreate(obs_data_t *settings, obs_source_t *source)
 	struct heartRateSource *hrs = new (data) heartRateSource();
 
 	hrs->source = source;
-	hrs->currentPpgAlgorithm = obs_data_get_int(settings, "ppg algorithm");
 
 	obs_enter_graphics();
 	char *effectFile = obs_module_file("test.effect");
@@ -283,6 +570,15 @@ void *heartRateSourceCreate(obs_data_t *settings, obs_source_t *source)
 	hrs->testing = gs_effect_create_from_file(effectFile, NULL);
 
 	bfree(effectFile);
+
+	// Without this effect the skin mean is always taken on the CPU
+	char *skinMeanFile = obs_module_file("skin_mean.effect");
+	hrs->skinMeanEffect = gs_effect_create_from_file(skinMeanFile, NULL);
+	bfree(skinMeanFile);
+	if (!hrs->skinMeanEffect) {
+		obs_log(LOG_WARNING, "Could not load the skin mean effect");
+	}
+
 	if (!hrs->testing) {
 		heartRateSourceDestroy(hrs);
 		hrs = NULL;
@@ -290,11 +586,18 @@ void *heartRateSourceCreate(obs_data_t *settings, obs_source_t *source)
 	obs_leave_graphics();
 
 	hrs->texrender = gs_texrender_create(GS_BGRA, GS_ZS_NONE);
+	hrs->detectionTexrender = gs_texrender_create(GS_BGRA, GS_ZS_NONE);
+	hrs->cropTexrender = gs_texrender_create(GS_BGRA, GS_ZS_NONE);
+	hrs->maskTexrender = gs_texrender_create(GS_R8, GS_ZS_NONE);
+	for (int i = 0; i < SKIN_MEAN_PASSES; i++) {
+		hrs->skinMeanTexrenders[i] = gs_texrender_create(GS_RGBA32F, GS_ZS_NONE);
+	}
 	createOBSHeartDisplaySourceIfNeeded(settings);
+	heartRateSourceUpdate(hrs, settings);
 
-	int64_t selectedFaceDetectionAlgorithm = obs_data_get_int(settings, "face detection algorithm");
-	hrs->faceDetection = FaceDetection::create(static_cast<FaceDetectionAlgorithm>(selectedFaceDetectionAlgorithm));
-	hrs->frameCount = 0;
+	hrs->framePool = FrameBufferPool::create(NUM_FRAME_BUFFERS);
+	hrs->cropPool = FrameBufferPool::create(NUM_FRAME_BUFFERS);
+	hrs->analysisWorker = std::make_unique<AnalysisWorker>();
 
 	return hrs;
 }
@@ -312,13 +615,23 @@ void heartRateSourceDestroy(void *data)
 
 	if (hrs) {
 		hrs->isDisabled = true;
+		MetricChannel::get().release(hrs);
 		obs_enter_graphics();
 		gs_texrender_destroy(hrs->texrender);
-		if (hrs->stagesurface) {
-			gs_stagesurface_destroy(hrs->stagesurface);
+		gs_texrender_destroy(hrs->detectionTexrender);
+		gs_texrender_destroy(hrs->cropTexrender);
+		stageRingDestroy(&hrs->stageRing);
+		stageRingDestroy(&hrs->cropRing);
+		gs_texrender_destroy(hrs->maskTexrender);
+		for (int i = 0; i < SKIN_MEAN_PASSES; i++) {
+			gs_texrender_destroy(hrs->skinMeanTexrenders[i]);
 		}
+		stageRingDestroy(&hrs->skinMeanRing);
 		gs_effect_destroy(hrs->testing);
+		gs_effect_destroy(hrs->skinMeanEffect);
 		obs_leave_graphics();
+		obs_weak_source_release(hrs->textSource);
+		obs_weak_source_release(hrs->moodSource);
 		hrs->~heartRateSource();
 		bfree(hrs);
 	}
@@ -331,7 +644,7 @@ void heartRateSourceDefaults(obs_data_t *settings)
 	obs_data_set_default_bool(settings, "enable face tracking", true);
 	obs_data_set_default_int(settings, "frame update interval", 60);
 	obs_data_set_default_int(settings, "ppg algorithm", 2);
-	obs_data_set_default_int(settings, "heart rate", -1);
+	obs_data_set_default_int(settings, "spectral estimator", 0);
 	obs_data_set_default_string(settings, "heart rate text", "Heart rate: {hr} BPM");
 	obs_data_set_default_bool(settings, "enable text source", true);
 	obs_data_set_default_bool(settings, "enable graph source", false);
@@ -347,6 +660,47 @@ void heartRateSourceDefaults(obs_data_t *settings)
 	obs_data_set_default_bool(settings, "post-filtering", true);
 	obs_data_set_default_bool(settings, "is disabled", false);
 	obs_data_set_default_int(settings, "heart rate graph size", 10);
+	obs_data_set_default_int(settings, "readback mode", READBACK_FULL_FRAME);
+	obs_data_set_default_bool(settings, "gpu skin mean", false);
+	obs_data_set_default_int(settings, "analysis rate", 30);
+}
+
+void heartRateSourceUpdate(void *data, obs_data_t *settings)
+{
+	struct heartRateSource *hrs = reinterpret_cast<struct heartRateSource *>(data);
+	if (!hrs) {
+		return;
+	}
+
+	hrs->readbackMode = obs_data_get_int(settings, "readback mode");
+	hrs->gpuSkinMean = obs_data_get_bool(settings, "gpu skin mean");
+	hrs->analysisRate = obs_data_get_int(settings, "analysis rate");
+
+	hrs->displayConfig.graphSize = obs_data_get_int(settings, "heart rate graph size");
+	hrs->displayConfig.graphPlane = obs_data_get_int(settings, "graph plane dropdown");
+	hrs->displayConfig.graphPlaneColour = static_cast<uint32_t>(obs_data_get_int(settings, "graph plane colour"));
+	hrs->displayConfig.graphLineColour = static_cast<uint32_t>(obs_data_get_int(settings, "graph line colour"));
+	hrs->displayConfig.ecgLineColour = static_cast<uint32_t>(obs_data_get_int(settings, "ecg line colour"));
+	hrs->displayConfig.ecgBackgroundColour =
+		static_cast<uint32_t>(obs_data_get_int(settings, "ecg background colour"));
+}
+
+// Replaces every {name} in text with value rounded, or with "--" while value is not known
+static void replacePlaceholder(std::string &text, const std::string &name, double value)
+{
+	std::string shown = value >= 0.0 ? std::to_string(static_cast<int>(std::round(value))) : "--";
+	for (size_t pos = text.find(name); pos != std::string::npos; pos = text.find(name, pos + shown.size())) {
+		text.replace(pos, name.size(), shown);
+	}
+}
+
+// Fills the heart rate variability placeholders of the display text, pNN50 as a percentage
+static void replaceHrvPlaceholders(std::string &text, const HrvStats &hrv)
+{
+	replacePlaceholder(text, "{ibi}", hrv.ibi);
+	replacePlaceholder(text, "{sdnn}", hrv.sdnn);
+	replacePlaceholder(text, "{rmssd}", hrv.rmssd);
+	replacePlaceholder(text, "{pnn50}", hrv.pnn50 >= 0.0 ? hrv.pnn50 * 100.0 : -1.0);
 }
 
 static bool updateProperties(obs_properties_t *props, obs_property_t *property, obs_data_t *settings)
@@ -413,13 +767,20 @@ static bool updateProperties(obs_properties_t *props, obs_property_t *property,
 	if (text_source) {
 		obs_data_t *text_settings = obs_source_get_settings(text_source);
 		if (text_settings) {
-			int heartRate = obs_data_get_int(settings, "heart rate");
+			struct heartRateMetrics metrics = MetricChannel::get().metrics();
+			int heartRate = static_cast<int>(std::round(metrics.heartRate));
 			if (heartRate > 0.0) {
 				std::string textFormat = obs_data_get_string(settings, "heart rate text");
 				size_t pos = textFormat.find("{hr}");
 				if (pos != std::string::npos) {
 					textFormat.replace(pos, 4, std::to_string(heartRate));
 				}
+				HrvStats hrv;
+				hrv.ibi = metrics.ibi;
+				hrv.sdnn = metrics.sdnn;
+				hrv.rmssd = metrics.rmssd;
+				hrv.pnn50 = metrics.pnn50;
+				replaceHrvPlaceholders(textFormat, hrv);
 				obs_data_set_string(text_settings, "text", textFormat.c_str());
 				obs_source_update(text_source, text_settings);
 			}
@@ -483,6 +844,7 @@ static obs_properties_t *algorithmProperties()
 	obs_property_list_add_int(ppgDropdown, obs_module_text("GreenChannel"), 0);
 	obs_property_list_add_int(ppgDropdown, obs_module_text("PCA"), 1);
 	obs_property_list_add_int(ppgDropdown, obs_module_text("Chrom"), 2);
+	obs_property_list_add_int(ppgDropdown, obs_module_text("POS"), 3);
 
 	// Add dropdown for pre-filtering methods
 	obs_property_t *preFilterDropdown = obs_properties_add_list(props, "pre-filtering method",
@@ -492,9 +854,32 @@ static obs_properties_t *algorithmProperties()
 	obs_property_list_add_int(preFilterDropdown, obs_module_text("Bandpass"), 1);
 	obs_property_list_add_int(preFilterDropdown, obs_module_text("Detrend"), 2);
 	obs_property_list_add_int(preFilterDropdown, obs_module_text("ZeroMean"), 3);
+	obs_property_list_add_int(preFilterDropdown, obs_module_text("BandpassZeroPhase"), 4);
 
 	// Add boolean tick box for post-filtering
 	obs_properties_add_bool(props, "post-filtering", obs_module_text("PostFilteringAlgorithm"));
+
+	// Add dropdown for how the heart rate is picked from the pulse spectrum
+	obs_property_t *estimatorDropdown = obs_properties_add_list(props, "spectral estimator",
+								    obs_module_text("SpectralEstimator"),
+								    OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(estimatorDropdown, obs_module_text("SpectralEstimatorWelch"), 0);
+	obs_property_list_add_int(estimatorDropdown, obs_module_text("SpectralEstimatorGoertzel"), 1);
+	obs_properties_add_text(props, "spectral estimator explain", obs_module_text("SpectralEstimatorExplain"),
+				OBS_TEXT_INFO);
+
+	// Add dropdown for how much of the frame is read back from the GPU
+	obs_property_t *readbackDropdown = obs_properties_add_list(props, "readback mode",
+								   obs_module_text("ReadbackMode"),
+								   OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(readbackDropdown, obs_module_text("ReadbackFullFrame"), READBACK_FULL_FRAME);
+	obs_property_list_add_int(readbackDropdown, obs_module_text("ReadbackDownscaled"), READBACK_DOWNSCALED);
+	obs_properties_add_text(props, "readback mode explain", obs_module_text("ReadbackModeExplain"),
+				OBS_TEXT_INFO);
+
+	// Allow user to take the skin colour mean on the GPU
+	obs_properties_add_bool(props, "gpu skin mean", obs_module_text("GpuSkinMean"));
+	obs_properties_add_text(props, "gpu skin mean explain", obs_module_text("GpuSkinMeanExplain"), OBS_TEXT_INFO);
 	obs_property_set_modified_callback(dropdown, updateProperties);
 	obs_property_set_modified_callback(enableTracker, updateProperties);
 	obs_property_set_modified_callback(ppgDropdown, updateProperties);
@@ -508,6 +893,15 @@ obs_properties_t *heartRateSourceProperties(void *data)
 
 	obs_properties_add_int(props, "fps", obs_module_text("fps"), 1, 120, 1);
 
+	// Rate the colour is sampled at, independent of the canvas frame rate
+	obs_property_t *analysisRate = obs_properties_add_list(props, "analysis rate", obs_module_text("AnalysisRate"),
+							       OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(analysisRate, obs_module_text("AnalysisRateEveryFrame"), 0);
+	obs_property_list_add_int(analysisRate, obs_module_text("AnalysisRate15"), 15);
+	obs_property_list_add_int(analysisRate, obs_module_text("AnalysisRate20"), 20);
+	obs_property_list_add_int(analysisRate, obs_module_text("AnalysisRate30"), 30);
+	obs_properties_add_text(props, "analysis rate explain", obs_module_text("AnalysisRateExplain"), OBS_TEXT_INFO);
+
 	obs_property_t *enableText =
 		obs_properties_add_bool(props, "enable text source", obs_module_text("TextSourceEnable"));
 	obs_property_t *heartRateText =
@@ -573,6 +967,7 @@ void heartRateSourceActivate(void *data)
 {
 	struct heartRateSource *hrs = reinterpret_cast<heartRateSource *>(data);
 	hrs->isDisabled = false;
+	hrs->displayConfig.isDisabled = false;
 	obs_data_t *settings = obs_source_get_settings(hrs->source);
 	obs_data_set_bool(settings, "is disabled", false);
 	obs_data_release(settings);
@@ -582,16 +977,60 @@ void heartRateSourceDeactivate(void *data)
 {
 	struct heartRateSource *hrs = reinterpret_cast<heartRateSource *>(data);
 	hrs->isDisabled = true;
+	hrs->displayConfig.isDisabled = true;
+	MetricChannel::get().publishConfig(hrs, hrs->displayConfig);
 	obs_data_t *settings = obs_source_get_settings(hrs->source);
 	obs_data_set_bool(settings, "is disabled", true);
 	obs_data_release(settings);
 }
 
 // Tick function
-void heartRateSourceTick(void *data, float seconds)
+std::string getMood(int heart_rate)
+{
+	std::string mood;
+	if (heart_rate > 150) {
+		mood = "Extremely hyped";
+	} else if (heart_rate > 120) {
+		mood = "Very Intense";
+	} else if (heart_rate > 90) {
+		mood = "Excited";
+	} else if (heart_rate > 60) {
+		mood = "Normal";
+	} else {
+		mood = "Extremely calm";
+	}
+	return mood;
+}
+
+// Set the text of a display source if it has changed. The source is only looked up by name again once the cached
+// weak reference no longer resolves, e.g. after it was removed and recreated
+static void updateDisplaySource(obs_weak_source_t **weakSource, const char *name, const std::string &text,
+				std::string &shownText)
 {
-	UNUSED_PARAMETER(seconds);
+	obs_source_t *source = obs_weak_source_get_source(*weakSource);
+	if (!source) {
+		obs_weak_source_release(*weakSource);
+		*weakSource = nullptr;
+		source = obs_get_source_by_name(name);
+		if (!source) {
+			return;
+		}
+		*weakSource = obs_source_get_weak_source(source);
+		shownText.clear();
+	}
 
+	if (text != shownText) {
+		obs_data_t *sourceSettings = obs_data_create();
+		obs_data_set_string(sourceSettings, "text", text.c_str());
+		obs_source_update(source, sourceSettings);
+		obs_data_release(sourceSettings);
+		shownText = text;
+	}
+	obs_source_release(source);
+}
+
+void heartRateSourceTick(void *data, float seconds)
+{
 	struct heartRateSource *hrs = reinterpret_cast<struct heartRateSource *>(data);
 
 	if (hrs->isDisabled) {
@@ -601,46 +1040,79 @@ void heartRateSourceTick(void *data, float seconds)
 	if (!obs_source_enabled(hrs->source)) {
 		return;
 	}
-}
-
-static bool getBGRAFromStageSurface(struct heartRateSource *hrs)
-{
-	uint32_t width;
-	uint32_t height;
 
-	// Check if the source is enabled
-	if (!obs_source_enabled(hrs->source)) {
-		return false;
+	// The text and mood sources re-rasterise on every update, so only update them a few times a second
+	hrs->displayElapsed += seconds;
+	if (hrs->displayElapsed < DISPLAY_UPDATE_INTERVAL) {
+		return;
 	}
+	hrs->displayElapsed = 0.0f;
 
-	// Retrieve the target source of the filter
-	obs_source_t *target;
-	if (hrs->source) {
-		target = obs_filter_get_target(hrs->source);
-	} else {
-		return false;
+	std::shared_ptr<const struct analysisResult> result = hrs->analysisWorker->latestResult();
+	double heartRate = result->heartRate;
+	bool noFaceDetected = result->noFaceDetected;
+
+	std::string heartRateText;
+	std::string moodText;
+
+	if (heartRate > 0.0) {
+		obs_data_t *hrsSettings = obs_source_get_settings(hrs->source);
+		heartRateText = obs_data_get_string(hrsSettings, "heart rate text");
+		obs_data_release(hrsSettings);
+
+		// Provisional estimates are marked as approximate and give no mood yet
+		std::string rate = std::to_string(static_cast<int>(std::round(heartRate)));
+		if (result->provisional) {
+			rate = "~" + rate;
+		}
+		size_t pos = heartRateText.find("{hr}");
+		if (pos != std::string::npos) {
+			heartRateText.replace(pos, 4, rate);
+		} else {
+			heartRateText = "Heart rate: " + rate + " BPM";
+		}
+		replaceHrvPlaceholders(heartRateText, result->hrv);
+		moodText = result->provisional ? "Calibrating..." : "Mood: " + getMood(heartRate);
+	} else if (noFaceDetected) { // output "No Face Detected"
+		heartRateText = "No Face Detected";
+		moodText = "No Face Detected";
+	} else if (heartRate == -1.0) { // output "Calibrating..."
+		heartRateText = "Calibrating...";
+		moodText = "Calibrating...";
 	}
-	if (!target) {
-		return false;
+
+	if (noFaceDetected || heartRate != 0.0) {
+		updateDisplaySource(&hrs->textSource, TEXT_SOURCE_NAME, heartRateText, hrs->shownHeartRateText);
+		updateDisplaySource(&hrs->moodSource, MOOD_SOURCE_NAME, moodText, hrs->shownMoodText);
 	}
+}
 
-	// Retrieve the base dimensions of the target source
-	width = obs_source_get_base_width(target);
-	height = obs_source_get_base_height(target);
-	if (width == 0 || height == 0) {
-		return false;
+// Number of rendered frames per analysis frame, and the sample rate that results from it. With no analysis rate set
+// every frame is analysed at the frame rate entered by the user
+static uint32_t getAnalysisStep(struct heartRateSource *hrs, int64_t userFps, double *sampleRate)
+{
+	struct obs_video_info ovi;
+	if (hrs->analysisRate <= 0 || !obs_get_video_info(&ovi) || ovi.fps_num == 0 || ovi.fps_den == 0) {
+		*sampleRate = static_cast<double>(userFps);
+		return 1;
 	}
 
-	obs_enter_graphics();
+	// Whole frame steps keep the samples evenly spaced, so the true rate can differ slightly from the one requested
+	double canvasFps = static_cast<double>(ovi.fps_num) / ovi.fps_den;
+	uint32_t step = static_cast<uint32_t>(std::max(1L, std::lround(canvasFps / hrs->analysisRate)));
+	*sampleRate = canvasFps / step;
+	return step;
+}
 
+// Render the target source into hrs->texrender at its base size
+static bool renderTarget(struct heartRateSource *hrs, obs_source_t *target, uint32_t width, uint32_t height)
+{
 	// Resets the texture renderer and begins rendering with the specified width and height
 	gs_texrender_reset(hrs->texrender);
 	if (!hrs->texrender) {
-		obs_leave_graphics();
 		return false;
 	}
 	if (!gs_texrender_begin(hrs->texrender, width, height)) {
-		obs_leave_graphics();
 		return false;
 	}
 
@@ -689,60 +1161,128 @@ static bool getBGRAFromStageSurface(struct heartRateSource *hrs)
 
 	// This function ends the texture rendering process. It finalizes the rendering operations and makes the rendered texture available for further processing. This function completes the rendering process, ensuring that the rendered texture is properly finalised and can be used for subsequent operations, such as extracting pixel data or further processing
 	gs_texrender_end(hrs->texrender);
+	return true;
+}
 
-	// Retrieve the old existing stage surface
-	if (hrs->stagesurface) {
-		uint32_t stagesurfWidth = gs_stagesurface_get_width(hrs->stagesurface);
-		uint32_t stagesurfHeight = gs_stagesurface_get_height(hrs->stagesurface);
-		// If it still matches the new width and height, reuse it
-		if (stagesurfWidth != width || stagesurfHeight != height) {
-			// Destroy the old stage surface
-			gs_stagesurface_destroy(hrs->stagesurface);
-			hrs->stagesurface = nullptr;
-		}
+// Stages analysis frames and hands over the oldest staged frame once the GPU has copied it. The target is only rendered
+// on analysis frames, or on every frame if the debug boxes are drawn over it
+static bool getBGRAFromStageSurface(struct heartRateSource *hrs, bool analysisFrame, bool renderEveryFrame)
+{
+	uint32_t width;
+	uint32_t height;
+
+	// Check if the source is enabled
+	if (!obs_source_enabled(hrs->source)) {
+		return false;
+	}
+
+	// Retrieve the target source of the filter
+	obs_source_t *target;
+	if (hrs->source) {
+		target = obs_filter_get_target(hrs->source);
+	} else {
+		return false;
+	}
+	if (!target) {
+		return false;
+	}
+
+	// Retrieve the base dimensions of the target source
+	width = obs_source_get_base_width(target);
+	height = obs_source_get_base_height(target);
+	if (width == 0 || height == 0) {
+		return false;
 	}
 
-	// Create a new stage surface if necessary
-	if (!hrs->stagesurface) {
-		hrs->stagesurface = gs_stagesurface_create(width, height, GS_BGRA);
+	obs_enter_graphics();
+
+	if ((analysisFrame || renderEveryFrame) && !renderTarget(hrs, target, width, height)) {
+		obs_leave_graphics();
+		return false;
 	}
 
-	// Use gs_stage_texture to stage the texture from the texture renderer (hrs->texrender) to the stage surface (hrs->stagesurface). This operation transfers the rendered texture to the stage surface for further processing
-	gs_stage_texture(hrs->stagesurface, gs_texrender_get_texture(hrs->texrender));
+	// Copy the rendered texture into the next stage surface of the ring. The copy is only queued on the GPU here,
+	// the CPU reads it back a couple of frames later once it has completed. Frames between analysis frames are not
+	// staged at all, only frames staged earlier are still mapped
+	if (analysisFrame) {
+		gs_texture_t *texture = gs_texrender_get_texture(hrs->texrender);
+		if (hrs->readbackMode == READBACK_DOWNSCALED) {
+			stageDownscaled(hrs, texture, width, height);
+		} else {
+			struct vec4 fullFrame;
+			vec4_set(&fullFrame, 0.0f, 1.0f, 0.0f, 1.0f);
+			stageRingStage(&hrs->stageRing, texture, width, height, &fullFrame, hrs->renderFrame);
+		}
+		if (hrs->gpuSkinMean && hrs->skinMeanEffect && hrs->shownResult &&
+		    !hrs->shownResult->skinPolygons.empty()) {
+			stageSkinMean(hrs, texture, width, height);
+		}
+	}
 
-	// Use gs_stagesurface_map to map the stage surface and retrieve the video data and line size. The video_data pointer will point to the BGRA data, and linesize will indicate the number of bytes per line
+	// Map the oldest staged frame, if the GPU has had enough frames to finish copying it
 	uint8_t *video_data; // A pointer to the memory location where the BGRA data will be accessible
 	uint32_t linesize;   // The number of bytes per line (or row) of the image data
-	// The gs_stagesurface_map function creates a mapping between the GPU memory and the CPU memory. This allows the CPU to access the pixel data directly from the GPU memory
-	if (!gs_stagesurface_map(hrs->stagesurface, &video_data, &linesize)) {
+	int slot = stageRingMap(&hrs->stageRing, hrs->renderFrame, &video_data, &linesize);
+
+	// The face crop is only usable if it was staged in the same frame as the detection image
+	uint8_t *cropData;
+	uint32_t cropLinesize;
+	int cropSlot = stageRingMap(&hrs->cropRing, hrs->renderFrame, &cropData, &cropLinesize);
+
+	// Likewise for the skin mean reduced on the GPU
+	uint8_t *meanData;
+	uint32_t meanLinesize;
+	int meanSlot = stageRingMap(&hrs->skinMeanRing, hrs->renderFrame, &meanData, &meanLinesize);
+	hrs->renderFrame++;
+
+	if (cropSlot >= 0 && (slot < 0 || hrs->cropRing.stagedFrame[cropSlot] != hrs->stageRing.stagedFrame[slot])) {
+		stageRingUnmap(&hrs->cropRing, cropSlot);
+		cropSlot = -1;
+	}
+	if (meanSlot >= 0 &&
+	    (slot < 0 || hrs->skinMeanRing.stagedFrame[meanSlot] != hrs->stageRing.stagedFrame[slot])) {
+		stageRingUnmap(&hrs->skinMeanRing, meanSlot);
+		meanSlot = -1;
+	}
+	if (slot < 0) {
 		obs_leave_graphics();
 		return false;
 	}
 
+	// Mean colour is the masked colour sum over the mask sum, in the R, G, B order of the CPU mean
+	std::vector<double_t> skinMean;
+	if (meanSlot >= 0) {
+		const float *pixel = reinterpret_cast<const float *>(meanData);
+		if (pixel[3] > 0.0f) {
+			skinMean = {255.0 * pixel[0] / pixel[3], 255.0 * pixel[1] / pixel[3],
+				    255.0 * pixel[2] / pixel[3]};
+		}
+		stageRingUnmap(&hrs->skinMeanRing, meanSlot);
+	}
+
+	bool copied;
 	{
 		std::lock_guard<std::mutex> lock(hrs->bgraDataMutex);
-		std::shared_ptr<input_BGRA_data> bgraData(
-			static_cast<input_BGRA_data *>(bzalloc(sizeof(input_BGRA_data))), [](input_BGRA_data *p) {
-				if (p)
-					bfree(p);
-			});
-
-		bgraData->width = width;
-		bgraData->height = height;
-		bgraData->linesize = linesize;
-		bgraData->data = video_data;
-		hrs->bgraData = bgraData;
+		hrs->bgraData = createBGRAData(hrs->framePool.get(), &hrs->stageRing, slot, video_data, linesize);
+		hrs->faceCrop = cropSlot >= 0 ? createBGRAData(hrs->cropPool.get(), &hrs->cropRing, cropSlot, cropData,
+							       cropLinesize)
+					      : nullptr;
+		hrs->skinMean = std::move(skinMean);
+		copied = hrs->bgraData != nullptr;
 	}
 
 	// Use gs_stagesurface_unmap to unmap the stage surface, releasing the mapped memory.
-	gs_stagesurface_unmap(hrs->stagesurface);
+	stageRingUnmap(&hrs->stageRing, slot);
+	if (cropSlot >= 0) {
+		stageRingUnmap(&hrs->cropRing, cropSlot);
+	}
 
 	obs_leave_graphics();
-	return true;
+	return copied;
 }
 
 static gs_texture_t *drawRectangle(struct heartRateSource *hrs, uint32_t width, uint32_t height,
-				   std::vector<struct vec4> &faceCoordinates)
+				   const std::vector<struct vec4> &faceCoordinates)
 {
 	gs_texture_t *blurredTexture = gs_texture_create(width, height, GS_BGRA, 1, nullptr, 0);
 	gs_copy_texture(blurredTexture, gs_texrender_get_texture(hrs->texrender));
@@ -775,23 +1315,6 @@ static gs_texture_t *drawRectangle(struct heartRateSource *hrs, uint32_t width,
 	return blurredTexture;
 }
 
-std::string getMood(int heart_rate)
-{
-	std::string mood;
-	if (heart_rate > 150) {
-		mood = "Extremely hyped";
-	} else if (heart_rate > 120) {
-		mood = "Very Intense";
-	} else if (heart_rate > 90) {
-		mood = "Excited";
-	} else if (heart_rate > 60) {
-		mood = "Normal";
-	} else {
-		mood = "Extremely calm";
-	}
-	return mood;
-}
-
 // Render function
 void heartRateSourceRender(void *data, gs_effect_t *effect)
 {
@@ -808,11 +1331,6 @@ void heartRateSourceRender(void *data, gs_effect_t *effect)
 		return;
 	}
 
-	if (!getBGRAFromStageSurface(hrs)) {
-		skipVideoFilterIfSafe(hrs->source);
-		return;
-	}
-
 	if (!hrs->testing) {
 		obs_log(LOG_INFO, "Effect not loaded");
 		// Effect failed to load, skip rendering
@@ -822,112 +1340,70 @@ void heartRateSourceRender(void *data, gs_effect_t *effect)
 
 	obs_data_t *hrsSettings = obs_source_get_settings(hrs->source);
 
-	int64_t selectedFaceDetectionAlgorithm = obs_data_get_int(hrsSettings, "face detection algorithm");
 	bool enableDebugBoxes = obs_data_get_bool(hrsSettings, "face detection debug boxes");
-	bool enableTracker = obs_data_get_bool(hrsSettings, "enable face tracking");
-	int64_t frameUpdateInterval = obs_data_get_int(hrsSettings, "frame update interval");
-
-	std::vector<struct vec4> faceCoordinates;
-	std::vector<double_t> avg;
-
-	// User has changed face detection algorithm, recreate the face detection object
-	if ((selectedFaceDetectionAlgorithm == 0 && dynamic_cast<DlibFaceDetection *>(hrs->faceDetection.get())) ||
-	    (selectedFaceDetectionAlgorithm == 1 &&
-	     dynamic_cast<HaarCascadeFaceDetection *>(hrs->faceDetection.get()))) {
-		hrs->faceDetection =
-			FaceDetection::create(static_cast<FaceDetectionAlgorithm>(selectedFaceDetectionAlgorithm));
-	}
-
-	if (hrs->faceDetection) {
-		uint64_t start_face_detection, end_face_detection;
-		if (enableTiming) {
-			start_face_detection = os_gettime_ns();
-		}
-		avg = hrs->faceDetection->detectFace(hrs->bgraData, faceCoordinates, enableDebugBoxes, enableTracker,
-						     frameUpdateInterval);
-		if (enableTiming) {
-			end_face_detection = os_gettime_ns();
-			obs_log(LOG_INFO, "Face detection took: %lu ns", end_face_detection - start_face_detection);
-		}
-	}
-
-	int64_t fps = obs_data_get_int(hrsSettings, "fps");
-	double heartRate = -1.0;
-	bool noFaceDetected = false;
-	if (!(std::all_of(avg.begin(), avg.end(), [](double_t val) { return val == 0.0; }))) { // face detected
-		// Get the settings for calculating the heart rate
-		int64_t selectedPpgAlgorithm = obs_data_get_int(hrsSettings, "ppg algorithm");
-		int64_t selectedPreFiltering = obs_data_get_int(hrsSettings, "pre-filtering method");
-		bool enablePostFiltering = obs_data_get_bool(hrsSettings, "post-filtering");
-		int64_t selectedPostFiltering = enablePostFiltering ? 1 : 0;
-
-		// Check if the ppg algorithm has changed
-		if (selectedPpgAlgorithm != hrs->currentPpgAlgorithm) {
-			movingAvg = MovingAvg(); // Create a new instance of MovingAvg
-			hrs->currentPpgAlgorithm = selectedPpgAlgorithm;
-		}
-
-		hrs->frameCount = 0; // reset frame count
-
-		heartRate = movingAvg.calculateHeartRate(avg, selectedPreFiltering, selectedPpgAlgorithm,
-							 selectedPostFiltering, true, fps);
-	} else { // no face detected
-		hrs->frameCount += 1;
-		if (hrs->frameCount >= fps) { // if no face detected more than 1 second
-			noFaceDetected = true;
-		}
-	}
-
-	std::string heartRateText;
-	std::string moodText;
-
-	obs_data_set_int(hrsSettings, "heart rate", static_cast<int>(std::round(heartRate)));
-	if (heartRate > 0.0) {
 
-		heartRateText = obs_data_get_string(hrsSettings, "heart rate text");
-		size_t pos = heartRateText.find("{hr}");
-		if (pos != std::string::npos) {
-			heartRateText.replace(pos, 4, std::to_string(static_cast<int>(std::round(heartRate))));
-		} else {
-			heartRateText =
-				"Heart rate: " + std::to_string(static_cast<int>(std::round(heartRate))) + " BPM";
+	// Only every step-th rendered frame is read back and analysed
+	double sampleRate;
+	uint32_t analysisStep = getAnalysisStep(hrs, obs_data_get_int(hrsSettings, "fps"), &sampleRate);
+	bool analysisFrame = hrs->framesSinceAnalysis == 0;
+	hrs->framesSinceAnalysis = (hrs->framesSinceAnalysis + 1) % analysisStep;
+
+	if (getBGRAFromStageSurface(hrs, analysisFrame, enableDebugBoxes)) {
+		// Hand the frame over to the analysis thread, together with the settings it should be analysed with
+		struct analysisFrame frame;
+		{
+			std::lock_guard<std::mutex> lock(hrs->bgraDataMutex);
+			frame.bgraData = std::move(hrs->bgraData);
+			frame.faceCrop = std::move(hrs->faceCrop);
+			frame.skinMean = std::move(hrs->skinMean);
 		}
-		moodText = "Mood: " + getMood(heartRate);
-	} else if (noFaceDetected) { // output "No Face Detected"
-		heartRateText = "No Face Detected";
-		moodText = "No Face Detected";
-	} else if (heartRate == -1.0) { // output "Calibrating..."
-		heartRateText = "Calibrating...";
-		moodText = "Calibrating...";
+		frame.settings.faceDetectionAlgorithm = obs_data_get_int(hrsSettings, "face detection algorithm");
+		frame.settings.enableDebugBoxes = enableDebugBoxes;
+		frame.settings.enableTracker = obs_data_get_bool(hrsSettings, "enable face tracking");
+		frame.settings.frameUpdateInterval = obs_data_get_int(hrsSettings, "frame update interval");
+		frame.settings.fps = std::max(1L, std::lround(sampleRate));
+		frame.settings.ppgAlgorithm = obs_data_get_int(hrsSettings, "ppg algorithm");
+		frame.settings.preFiltering = obs_data_get_int(hrsSettings, "pre-filtering method");
+		frame.settings.postFiltering = obs_data_get_bool(hrsSettings, "post-filtering") ? 1 : 0;
+		frame.settings.spectralEstimator = obs_data_get_int(hrsSettings, "spectral estimator");
+		frame.settings.gpuSkinMean = hrs->gpuSkinMean && hrs->skinMeanEffect;
+		hrs->analysisWorker->publish(std::move(frame));
 	}
 
-	if (noFaceDetected || heartRate != 0.0) {
-		// Updating heart rate text source
-		obs_source_t *source = obs_get_source_by_name(TEXT_SOURCE_NAME);
-		if (source) {
-			obs_data_t *sourceSettings = obs_source_get_settings(source);
-			obs_data_set_string(sourceSettings, "text", heartRateText.c_str());
-			obs_source_update(source, sourceSettings);
-			obs_data_release(sourceSettings);
-			obs_source_release(source);
-		}
-
-		// Updating mood source
-		source = obs_get_source_by_name(MOOD_SOURCE_NAME);
-		if (source) {
-			obs_data_t *sourceSettings = obs_source_get_settings(source);
-			obs_data_set_string(sourceSettings, "text", moodText.c_str());
-			obs_source_update(source, sourceSettings);
-			obs_data_release(sourceSettings);
-			obs_source_release(source);
-		}
-	}
+	// Show the most recent result, the analysis of this frame completes in the background
+	hrs->shownResult = hrs->analysisWorker->latestResult();
+	const struct analysisResult &result = *hrs->shownResult;
+	const std::vector<struct vec4> &faceCoordinates = result.faceCoordinates;
+	hrs->faceBox = result.faceBox;
+	hrs->hasFaceBox = result.hasFaceBox;
 
 	obs_data_release(hrsSettings);
 
+	// Publish for the graph and ECG sources
+	struct heartRateMetrics metrics = {};
+	metrics.heartRate = result.heartRate;
+	metrics.confidence = result.confidence;
+	metrics.provisional = result.provisional;
+	metrics.ibi = result.hrv.ibi;
+	metrics.sdnn = result.hrv.sdnn;
+	metrics.rmssd = result.hrv.rmssd;
+	metrics.pnn50 = result.hrv.pnn50;
+	metrics.timestamp = result.timestamp;
+	metrics.numBvp = static_cast<uint32_t>(std::min<size_t>(result.bvp.size(), METRIC_BVP_SAMPLES));
+	std::copy(result.bvp.begin(), result.bvp.begin() + metrics.numBvp, metrics.bvp);
+	MetricChannel::get().publishMetrics(hrs, metrics);
+	MetricChannel::get().publishConfig(hrs, hrs->displayConfig);
+
 	if (enableDebugBoxes) {
-		gs_texture_t *testingTexture =
-			drawRectangle(hrs, hrs->bgraData->width, hrs->bgraData->height, faceCoordinates);
+		// The frame read back may be downscaled, draw the boxes at the size of the rendered source
+		gs_texture_t *renderedTexture = gs_texrender_get_texture(hrs->texrender);
+		if (!renderedTexture) {
+			skipVideoFilterIfSafe(hrs->source);
+			return;
+		}
+		uint32_t width = gs_texture_get_width(renderedTexture);
+		uint32_t height = gs_texture_get_height(renderedTexture);
+		gs_texture_t *testingTexture = drawRectangle(hrs, width, height, faceCoordinates);
 
 		if (!obs_source_process_filter_begin(hrs->source, GS_BGRA, OBS_ALLOW_DIRECT_RENDERING)) {
 			skipVideoFilterIfSafe(hrs->source);
@@ -940,8 +1416,7 @@ void heartRateSourceRender(void *data, gs_effect_t *effect)
 		gs_reset_blend_state();
 
 		if (hrs->source) {
-			obs_source_process_filter_tech_end(hrs->source, hrs->testing, hrs->bgraData->width,
-							   hrs->bgraData->height, "Draw");
+			obs_source_process_filter_tech_end(hrs->source, hrs->testing, width, height, "Draw");
 		}
 
 		gs_blend_state_pop();
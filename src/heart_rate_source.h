@@ -2,10 +2,18 @@
 #define HEART_RATE_SOURCE_H
 
 #include <obs-module.h>
+#include <graphics/vec2.h>
+#include <graphics/vec4.h>
 
 #ifdef __cplusplus
+#include <memory>
 #include <mutex>
-#include "algorithm/face_detection/face_detection.h"
+#include <string>
+#include <vector>
+#include "metric_channel.h"
+class AnalysisWorker;
+class FrameBufferPool;
+struct analysisResult;
 #else
 #include <stdbool.h>
 #endif
@@ -21,31 +29,95 @@ extern "C" {
 #define MOOD_SOURCE_NAME obs_module_text("HeartRateMood")
 #define ECG_SOURCE_NAME obs_module_text("HeartRateECG")
 
+#define NUM_STAGE_SURFACES 3
+
+// Height of the downscaled image read back for face detection
+#define DETECTION_HEIGHT 360
+// Fraction of the face box size added on each side of the full-resolution face crop
+#define FACE_CROP_MARGIN 0.25f
+// Face crop sizes are rounded up to a multiple of this many pixels, so the crop surfaces are reused as the face moves
+#define FACE_CROP_STEP 64
+
+// Size of the masked face texture reduced to a single pixel on the GPU, 4x4 texels at a time
+#define SKIN_MEAN_SIZE 256
+#define SKIN_MEAN_PASSES 5
+
+// Seconds between updates of the text and mood sources
+#define DISPLAY_UPDATE_INTERVAL 0.25f
+
+enum readbackMode { READBACK_FULL_FRAME, READBACK_DOWNSCALED };
+
 extern bool enableTiming;
 struct input_BGRA_data {
 	uint8_t *data;
 	uint32_t width;
 	uint32_t height;
 	uint32_t linesize;
+	struct vec4 region; // Normalised (minX, maxX, minY, maxY) area of the source frame covered by the data
+	uint64_t timestamp; // Video frame time in nanoseconds
+};
+
+// A ring of stage surfaces so a frame can be staged while an older one is mapped,
+// instead of waiting for the GPU to finish the copy in the same frame
+struct stageRing {
+	gs_stagesurf_t *surfaces[NUM_STAGE_SURFACES];
+	uint64_t stagedFrame[NUM_STAGE_SURFACES];
+	uint64_t stagedTime[NUM_STAGE_SURFACES];
+	bool staged[NUM_STAGE_SURFACES];
+	struct vec4 region[NUM_STAGE_SURFACES];
+	uint32_t writeIndex;
 };
 
 struct heartRateSource {
 	obs_source_t *source;
 	gs_texrender_t *texrender;
-	gs_stagesurf_t *stagesurface;
+	struct stageRing stageRing;
+	gs_texrender_t *detectionTexrender;
+	gs_texrender_t *cropTexrender;
+	struct stageRing cropRing;
+	uint32_t cropWidth;
+	uint32_t cropHeight;
+	uint64_t renderFrame;
+	int64_t readbackMode;
+	struct vec4 faceBox;
+	bool hasFaceBox;
 	gs_effect_t *testing;
+	gs_effect_t *skinMeanEffect;
+	gs_texrender_t *maskTexrender;
+	gs_texrender_t *skinMeanTexrenders[SKIN_MEAN_PASSES];
+	struct stageRing skinMeanRing;
+	bool gpuSkinMean;
+	int64_t analysisRate;
+	uint32_t framesSinceAnalysis;
+	obs_weak_source_t *textSource;
+	obs_weak_source_t *moodSource;
+	float displayElapsed;
 #ifdef __cplusplus
 	std::shared_ptr<struct input_BGRA_data> bgraData;
+	std::shared_ptr<struct input_BGRA_data> faceCrop;
 	std::mutex bgraDataMutex;
-	std::unique_ptr<FaceDetection> faceDetection;
+	std::unique_ptr<AnalysisWorker> analysisWorker;
+	std::shared_ptr<FrameBufferPool> framePool;
+	std::shared_ptr<FrameBufferPool> cropPool; // Separate, so the small face crops never grow to full frames
+	std::shared_ptr<const struct analysisResult> shownResult; // Latest analysis, whose skin mask is drawn on the GPU
+	std::vector<double_t> skinMean;
+	std::string shownHeartRateText;
+	std::string shownMoodText;
+	struct graphDisplayConfig displayConfig;
 #else
 	struct input_BGRA_data *bgraData;
+	struct input_BGRA_data *faceCrop;
 	void *bgraDataMutex; // Placeholder for C compatibility
-	void *faceDetection;
+	void *analysisWorker;
+	void *framePool;
+	void *cropPool;
+	void *shownResult;
+	void *skinMean;
+	void *shownHeartRateText;
+	void *shownMoodText;
+	void *displayConfig;
 #endif
-	int64_t currentPpgAlgorithm;
 	bool isDisabled;
-	int frameCount;
 };
 
 // Function declarations
@@ -53,6 +125,7 @@ const char *getHeartRateSourceName(void *);
 void *heartRateSourceCreate(obs_data_t *settings, obs_source_t *source);
 void heartRateSourceDestroy(void *data);
 void heartRateSourceDefaults(obs_data_t *settings);
+void heartRateSourceUpdate(void *data, obs_data_t *settings);
 obs_properties_t *heartRateSourceProperties(void *data);
 void heartRateSourceActivate(void *data);
 void heartRateSourceDeactivate(void *data);
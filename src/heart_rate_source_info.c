@@ -10,6 +10,7 @@ struct obs_source_info heartRateSourceInfo = {
 	.activate = heartRateSourceActivate,
 	.deactivate = heartRateSourceDeactivate,
 	.get_defaults = heartRateSourceDefaults,
+	.update = heartRateSourceUpdate,
 	.get_properties = heartRateSourceProperties,
 	.video_tick = heartRateSourceTick,
 	.video_render = heartRateSourceRender,
@@ -0,0 +1,50 @@
+#include "metric_channel.h"
+
+static struct heartRateMetrics calibratingMetrics()
+{
+	struct heartRateMetrics metrics = {};
+	metrics.heartRate = -1.0;
+	metrics.confidence = -1.0;
+	metrics.ibi = metrics.sdnn = metrics.rmssd = metrics.pnn50 = -1.0;
+	return metrics;
+}
+
+MetricChannel &MetricChannel::get()
+{
+	static MetricChannel channel;
+	return channel;
+}
+
+MetricChannel::MetricChannel()
+{
+	metricsLock.store(calibratingMetrics());
+}
+
+bool MetricChannel::claim(const void *publisher)
+{
+	const void *expected = nullptr;
+	return owner.compare_exchange_strong(expected, publisher, std::memory_order_acq_rel) ||
+	       expected == publisher;
+}
+
+void MetricChannel::publishMetrics(const void *publisher, const struct heartRateMetrics &metrics)
+{
+	if (claim(publisher)) {
+		metricsLock.store(metrics);
+	}
+}
+
+void MetricChannel::publishConfig(const void *publisher, const struct graphDisplayConfig &config)
+{
+	if (claim(publisher)) {
+		configLock.store(config);
+	}
+}
+
+void MetricChannel::release(const void *publisher)
+{
+	const void *expected = publisher;
+	if (owner.compare_exchange_strong(expected, nullptr, std::memory_order_acq_rel)) {
+		metricsLock.store(calibratingMetrics());
+	}
+}
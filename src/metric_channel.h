@@ -0,0 +1,115 @@
+#ifndef METRIC_CHANNEL_H
+#define METRIC_CHANNEL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <type_traits>
+
+// Most recent blood volume pulse samples carried with each heart rate
+#define METRIC_BVP_SAMPLES 64
+
+// Latest estimate published by the heart rate filter
+struct heartRateMetrics {
+	double heartRate;              // BPM, -1 while calibrating
+	double confidence;             // Signal quality from 0 to 1, or -1 if not estimated
+	bool provisional;              // Rough estimate from the first seconds, made before calibration finishes
+	double ibi;                    // Latest inter-beat interval in milliseconds, or -1 if no beats were found yet
+	double sdnn;                   // Heart rate variability over the latest intervals in milliseconds, or -1
+	double rmssd;                  // Root mean square of successive interval differences in milliseconds, or -1
+	double pnn50;                  // Fraction of successive intervals more than 50 ms apart, or -1
+	uint64_t timestamp;            // Video frame time of the analysed frame, in nanoseconds
+	uint32_t numBvp;               // Valid samples at the start of bvp
+	float bvp[METRIC_BVP_SAMPLES]; // Oldest first
+};
+
+// Filter settings the graph and ECG sources draw with
+struct graphDisplayConfig {
+	int64_t graphSize;
+	int64_t graphPlane;
+	uint32_t graphPlaneColour;
+	uint32_t graphLineColour;
+	uint32_t ecgLineColour;
+	uint32_t ecgBackgroundColour;
+	bool isDisabled;
+};
+
+// Sequence lock over a trivially copyable value. Readers never lock and retry if a write happened while they
+// copied, writers are serialised by a mutex. The value is held as atomic words so concurrent copies are well defined.
+template<class T> class SeqLock {
+	static_assert(std::is_trivially_copyable<T>::value, "SeqLock values must be trivially copyable");
+	static constexpr size_t numWords = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+public:
+	SeqLock() { store(T{}); }
+
+	void store(const T &value)
+	{
+		uint64_t words[numWords] = {};
+		std::memcpy(words, &value, sizeof(T));
+
+		std::lock_guard<std::mutex> lock(writeMutex);
+		uint64_t seq = sequence.load(std::memory_order_relaxed);
+		sequence.store(seq + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		for (size_t i = 0; i < numWords; i++) {
+			data[i].store(words[i], std::memory_order_relaxed);
+		}
+		sequence.store(seq + 2, std::memory_order_release);
+	}
+
+	T load() const
+	{
+		uint64_t words[numWords];
+		while (true) {
+			uint64_t before = sequence.load(std::memory_order_acquire);
+			if (before & 1) {
+				continue; // A write is in progress
+			}
+			for (size_t i = 0; i < numWords; i++) {
+				words[i] = data[i].load(std::memory_order_relaxed);
+			}
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (sequence.load(std::memory_order_relaxed) == before) {
+				break;
+			}
+		}
+
+		T value;
+		std::memcpy(&value, words, sizeof(T));
+		return value;
+	}
+
+private:
+	std::atomic<uint64_t> sequence{0};
+	std::atomic<uint64_t> data[numWords];
+	std::mutex writeMutex;
+};
+
+// Carries the heart rate from the filter to the graph and ECG sources, which subscribe once instead of searching
+// every source for the filter and reading its settings each frame. Like that search, only the first filter
+// instance is followed: it claims the channel when it first publishes and releases it when destroyed.
+class MetricChannel {
+public:
+	static MetricChannel &get();
+
+	void publishMetrics(const void *publisher, const struct heartRateMetrics &metrics);
+	void publishConfig(const void *publisher, const struct graphDisplayConfig &config);
+	void release(const void *publisher);
+
+	bool hasPublisher() const { return owner.load(std::memory_order_acquire) != nullptr; }
+	struct heartRateMetrics metrics() const { return metricsLock.load(); }
+	struct graphDisplayConfig config() const { return configLock.load(); }
+
+private:
+	MetricChannel();
+	bool claim(const void *publisher);
+
+	std::atomic<const void *> owner{nullptr};
+	SeqLock<struct heartRateMetrics> metricsLock;
+	SeqLock<struct graphDisplayConfig> configLock;
+};
+
+#endif
@@ -0,0 +1,88 @@
+#include "heart_rate_algorithm.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <vector>
+
+// Every operator new in the program is counted while counting is set. Eigen allocates with malloc rather than new, so
+// its allocations are disallowed at runtime instead, which the library is built to check for
+static bool counting = false;
+static size_t allocations = 0;
+
+void *operator new(std::size_t size)
+{
+	if (counting) {
+		allocations++;
+	}
+	if (void *memory = std::malloc(size > 0 ? size : 1)) {
+		return memory;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void *memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept
+{
+	std::free(memory);
+}
+
+static const int FPS = 30;
+// Long enough for calibration, the provisional estimates and the first full ones
+static const int WARM_UP_SECONDS = 15;
+static const int MEASURED_SECONDS = 15;
+
+// Allocations made by estimates once a MovingAvg has warmed up with the given settings
+static size_t countAllocations(int preFilter, int ppg, int postFilter, int spectralEstimator)
+{
+	MovingAvg movingAvg;
+	std::vector<double_t> avg(3);
+	size_t counted = 0;
+	for (int i = 0; i < (WARM_UP_SECONDS + MEASURED_SECONDS) * FPS; ++i) {
+		double time = static_cast<double>(i) / FPS;
+		double pulse = std::sin(2.0 * M_PI * 1.2 * time);
+		avg[0] = 150.0 + 0.5 * pulse;
+		avg[1] = 100.0 + pulse;
+		avg[2] = 80.0 + 0.3 * pulse;
+
+		bool measured = i >= WARM_UP_SECONDS * FPS;
+		allocations = 0;
+		counting = measured;
+		Eigen::internal::set_is_malloc_allowed(!measured);
+		movingAvg.calculateHeartRate(avg, preFilter, ppg, postFilter, true, FPS, 1, time, spectralEstimator);
+		Eigen::internal::set_is_malloc_allowed(true);
+		counting = false;
+		counted += allocations;
+	}
+	return counted;
+}
+
+static bool checkSettings(int preFilter, int ppg, int postFilter, int spectralEstimator)
+{
+	size_t counted = countAllocations(preFilter, ppg, postFilter, spectralEstimator);
+	if (counted > 0) {
+		std::cerr << "Settings " << preFilter << ", " << ppg << ", " << postFilter << ", " << spectralEstimator
+			  << " allocated " << counted << " times once warmed up" << std::endl;
+	}
+	return counted == 0;
+}
+
+int main()
+{
+	bool passed = true;
+	for (int preFilter = 0; preFilter < 5; ++preFilter) {
+		for (int ppg = 0; ppg < 4; ++ppg) {
+			for (int postFilter = 0; postFilter < 2; ++postFilter) {
+				for (int spectralEstimator = 0; spectralEstimator < 2; ++spectralEstimator) {
+					passed = checkSettings(preFilter, ppg, postFilter, spectralEstimator) && passed;
+				}
+			}
+		}
+	}
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,121 @@
+#include "filtering/filter_util.h"
+
+#include <cmath>
+#include <complex>
+#include <iostream>
+
+// Analytic Butterworth magnitudes of the heart rate band-pass, |H| = 1 / sqrt(1 + ((w^2 - w0^2) / (w * bw))^(2N)) at
+// pre-warped frequencies, for the sample rates the evaluation videos use
+struct bandpassReference {
+	double fps;
+	double hz;
+	double magnitude;
+};
+
+static const bandpassReference BANDPASS_REFERENCE[] = {
+	{15.0, 0.20, 2.6065185579e-04}, {15.0, 0.50, 1.1719275270e-01}, {15.0, 0.65, 7.0710678119e-01},
+	{15.0, 1.00, 9.9997788356e-01}, {15.0, 1.40, 1.0000000000e+00}, {15.0, 2.00, 9.9999600342e-01},
+	{15.0, 3.00, 7.0710678119e-01}, {15.0, 4.00, 3.7043464889e-02}, {15.0, 6.00, 5.2643660757e-05},
+	{30.0, 0.20, 2.3097142425e-04}, {30.0, 0.50, 1.1049847994e-01}, {30.0, 0.65, 7.0710678119e-01},
+	{30.0, 1.00, 9.9998821927e-01}, {30.0, 1.40, 1.0000000000e+00}, {30.0, 2.00, 9.9998405509e-01},
+	{30.0, 3.00, 7.0710678119e-01}, {30.0, 4.00, 7.4659535708e-02}, {30.0, 6.00, 2.5186421277e-03},
+	{60.0, 0.20, 2.2421504467e-04}, {60.0, 0.50, 1.0890781506e-01}, {60.0, 0.65, 7.0710678119e-01},
+	{60.0, 1.00, 9.9998995443e-01}, {60.0, 1.40, 1.0000000000e+00}, {60.0, 2.00, 9.9997847674e-01},
+	{60.0, 3.00, 7.0710678119e-01}, {60.0, 4.00, 8.5578312467e-02}, {60.0, 6.00, 4.3009937304e-03},
+};
+
+static const double SAMPLE_RATES[] = {15.0, 30.0, 60.0};
+
+// Complex frequency response of the cascade at hz
+static std::complex<double> sosResponse(const std::vector<struct biquad> &sections, double hz, double fps)
+{
+	std::complex<double> zInv = std::polar(1.0, -2.0 * M_PI * hz / fps);
+	std::complex<double> response = 1.0;
+	for (const struct biquad &s : sections) {
+		response *= (s.b0 + s.b1 * zInv + s.b2 * zInv * zInv) / (1.0 + s.a1 * zInv + s.a2 * zInv * zInv);
+	}
+	return response;
+}
+
+// Closed-form response of the analog Butterworth band-pass at the frequency the bilinear transform maps hz to. The
+// low-pass prototype 1 / prod(p - p_k) is evaluated at p = (s^2 + w0^2) / (s * bw), which is 1 with zero phase at the
+// band centre, where the design is normalised
+static std::complex<double> analogResponse(double hz, double fps)
+{
+	double fs2 = 2.0 * fps;
+	double w1 = fs2 * std::tan(M_PI * BANDPASS_MIN_HZ / fps);
+	double w2 = fs2 * std::tan(M_PI * BANDPASS_MAX_HZ / fps);
+	double w = fs2 * std::tan(M_PI * hz / fps);
+	std::complex<double> p(0.0, (w * w - w1 * w2) / (w * (w2 - w1)));
+
+	std::complex<double> response = 1.0;
+	for (int k = 0; k < BANDPASS_ORDER; ++k) {
+		response /= p - std::polar(1.0, M_PI * (2.0 * k + BANDPASS_ORDER + 1) / (2.0 * BANDPASS_ORDER));
+	}
+	return response;
+}
+
+// Magnitudes against the stored reference
+static bool checkMagnitudes()
+{
+	bool passed = true;
+	for (const bandpassReference &reference : BANDPASS_REFERENCE) {
+		const std::vector<struct biquad> &sections = bandpassSections(static_cast<int>(reference.fps));
+		double magnitude = sosMagnitude(sections, reference.hz, reference.fps);
+		double tolerance = 1e-6 + 1e-6 * reference.magnitude;
+		if (sections.size() != BANDPASS_ORDER || std::fabs(magnitude - reference.magnitude) > tolerance) {
+			std::cerr << "Band-pass magnitude mismatch at " << reference.hz << " Hz, " << reference.fps
+				  << " FPS: " << magnitude << " instead of " << reference.magnitude << std::endl;
+			passed = false;
+		}
+	}
+	return passed;
+}
+
+// Magnitude and phase against the closed-form response, from near 0 Hz up to near the Nyquist frequency
+static bool checkResponse()
+{
+	bool passed = true;
+	for (double fps : SAMPLE_RATES) {
+		const std::vector<struct biquad> &sections = bandpassSections(static_cast<int>(fps));
+		for (double hz = 0.05; hz < fps / 2.0 - 0.05; hz += 0.05) {
+			std::complex<double> response = sosResponse(sections, hz, fps);
+			std::complex<double> reference = analogResponse(hz, fps);
+			if (std::abs(response - reference) > 1e-9) {
+				std::cerr << "Band-pass response mismatch at " << hz << " Hz, " << fps << " FPS: "
+					  << response << " instead of " << reference << std::endl;
+				passed = false;
+			}
+		}
+	}
+	return passed;
+}
+
+// Every section has its zeros at z = 1 and z = -1, the same gain and stable poles
+static bool checkSections()
+{
+	bool passed = true;
+	for (double fps : SAMPLE_RATES) {
+		const std::vector<struct biquad> &sections = bandpassSections(static_cast<int>(fps));
+		for (const struct biquad &s : sections) {
+			bool zeros = std::fabs(s.b1) < 1e-12 && std::fabs(s.b2 + s.b0) < 1e-12 &&
+				     std::fabs(s.b0 - sections[0].b0) < 1e-12;
+			bool stable = std::fabs(s.a2) < 1.0 && std::fabs(s.a1) < 1.0 + s.a2;
+			if (!zeros || !stable) {
+				std::cerr << "Band-pass section at " << fps << " FPS is not of the expected form: b = (" << s.b0
+					  << ", " << s.b1 << ", " << s.b2 << "), a = (1, " << s.a1 << ", " << s.a2 << ")"
+					  << std::endl;
+				passed = false;
+			}
+		}
+	}
+	return passed;
+}
+
+int main()
+{
+	bool passed = checkMagnitudes();
+	passed = checkResponse() && passed;
+	passed = checkSections() && passed;
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,123 @@
+#include "heart_rate_algorithm.h"
+#include "beat_detector.h"
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+static const int FPS = 30;
+// Pulse rate of the synthetic signals, not a whole number of samples per beat so the peaks fall between samples
+static const double PULSE_HZ = 1.13;
+// Spread of the intervals a steady pulse may still show, in milliseconds
+static const double MAX_STEADY_SPREAD = 1.0;
+
+// Times the statistics are checked at, in seconds. Intervals from start-up would still be in the ring at the earlier
+// ones, the first of which may come before there are enough intervals to report
+static const int CHECK_SECONDS[] = {15, 20, 60};
+
+// Whether the statistics show the intervals of a steady pulse. Until reported they only need the right latest interval
+static bool isSteady(const HrvStats &hrv, bool mustReport)
+{
+	bool ibi = hrv.ibi < 0.0 || std::fabs(hrv.ibi - 1000.0 / PULSE_HZ) < MAX_STEADY_SPREAD;
+	if (!mustReport && hrv.sdnn < 0.0) {
+		return ibi;
+	}
+	return ibi && hrv.sdnn >= 0.0 && hrv.sdnn < MAX_STEADY_SPREAD && hrv.rmssd >= 0.0 &&
+	       hrv.rmssd < MAX_STEADY_SPREAD;
+}
+
+// Skin means with a pulse at a constant rate: the intervals between beats must not vary at any of the check times
+static bool checkSteadyHrv(int preFilter, int ppg, int postFilter)
+{
+	MovingAvg movingAvg;
+	bool passed = true;
+	int i = 0;
+	for (int seconds : CHECK_SECONDS) {
+		for (; i <= seconds * FPS; ++i) {
+			double time = static_cast<double>(i) / FPS;
+			double pulse = std::sin(2.0 * M_PI * PULSE_HZ * time);
+			std::vector<double_t> avg = {150.0 + 0.5 * pulse, 100.0 + pulse, 80.0 + 0.3 * pulse};
+			movingAvg.calculateHeartRate(avg, preFilter, ppg, postFilter, true, FPS, 1, time);
+		}
+
+		HrvStats hrv = movingAvg.getHrv();
+		if (!isSteady(hrv, seconds > CHECK_SECONDS[0])) {
+			std::cerr << "Constant rate pulse with settings " << preFilter << ", " << ppg << ", "
+				  << postFilter << " gave at " << seconds << " s IBI " << hrv.ibi << " ms, SDNN "
+				  << hrv.sdnn << " ms, RMSSD " << hrv.rmssd << " ms" << std::endl;
+			passed = false;
+		}
+	}
+	return passed;
+}
+
+// Every setting, as beats should not depend on them
+static bool checkConstantRate()
+{
+	bool passed = true;
+	for (int preFilter = 0; preFilter < 5; ++preFilter) {
+		for (int ppg = 0; ppg < 4; ++ppg) {
+			for (int postFilter = 0; postFilter < 2; ++postFilter) {
+				passed = checkSteadyHrv(preFilter, ppg, postFilter) && passed;
+			}
+		}
+	}
+	return passed;
+}
+
+// Feeds seconds of a sinusoidal pulse at hz, starting at a trough
+static void pushPulse(BeatDetector &beats, double hz, double seconds)
+{
+	int samples = static_cast<int>(std::lround(seconds * FPS));
+	for (int i = 0; i < samples; ++i) {
+		beats.push(-std::cos(2.0 * M_PI * hz * i / FPS));
+	}
+}
+
+// Two steady runs at different rates with skipped samples between them: the change of rate shows in SDNN, but no
+// successive difference is taken across the gap
+static bool checkGap()
+{
+	BeatDetector beats;
+	beats.reset(FPS);
+	pushPulse(beats, 1.25, 8.0);
+	beats.skip(2 * FPS);
+	pushPulse(beats, 1.0, 8.0);
+
+	HrvStats hrv = beats.stats();
+	bool passed = hrv.sdnn > 50.0 && hrv.rmssd >= 0.0 && hrv.rmssd < MAX_STEADY_SPREAD && hrv.pnn50 == 0.0;
+	if (!passed) {
+		std::cerr << "Intervals across a gap gave SDNN " << hrv.sdnn << " ms, RMSSD " << hrv.rmssd
+			  << " ms, pNN50 " << hrv.pnn50 << std::endl;
+	}
+	return passed;
+}
+
+// The same with a pause instead, whose long interval is discarded against the expected one and so is a gap as well
+static bool checkDiscardedInterval()
+{
+	BeatDetector beats;
+	beats.reset(FPS);
+	beats.setExpectedInterval(0.9);
+	pushPulse(beats, 1.25, 8.0);
+	for (int i = 0; i < FPS; ++i) {
+		beats.push(-1.0);
+	}
+	pushPulse(beats, 1.0, 8.0);
+
+	HrvStats hrv = beats.stats();
+	bool passed = hrv.sdnn > 50.0 && hrv.rmssd >= 0.0 && hrv.rmssd < MAX_STEADY_SPREAD && hrv.pnn50 == 0.0;
+	if (!passed) {
+		std::cerr << "Intervals across a discarded one gave SDNN " << hrv.sdnn << " ms, RMSSD " << hrv.rmssd
+			  << " ms, pNN50 " << hrv.pnn50 << std::endl;
+	}
+	return passed;
+}
+
+int main()
+{
+	bool passed = checkConstantRate();
+	passed = checkGap() && passed;
+	passed = checkDiscardedInterval() && passed;
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,4 @@
+#include "heart_rate_source.h"
+
+// Defined by heart_rate_source.cpp in the plugin, the tests never log timings
+bool enableTiming = false;